@@ -94,6 +94,13 @@ go:	mov	ax,cs
 	xor	bh,bh
 	int	0x10		| save it in known place, con_init fetches
 	mov	[510],dx	| it from 0x90510.
+
+| get the size of extended memory (in kB, above 1Mb) from the bios,
+| and leave it where main() looks for it: 0x901FC.
+
+	mov	ah,#0x88
+	int	0x15
+	mov	[508],ax
 		
 | now we want to move to protected mode ...
 
@@ -298,12 +305,12 @@ kill_motor:
 gdt:
 	.word	0,0,0,0		| dummy
 
-	.word	0x07FF		| 8Mb - limit=2047 (2048*4096=8Mb)
+	.word	0x0FFF		| 16Mb - limit=4095 (4096*4096=16Mb)
 	.word	0x0000		| base address=0
 	.word	0x9A00		| code read/exec
 	.word	0x00C0		| granularity=4096, 386
 
-	.word	0x07FF		| 8Mb - limit=2047 (2048*4096=8Mb)
+	.word	0x0FFF		| 16Mb - limit=4095 (4096*4096=16Mb)
 	.word	0x0000		| base address=0
 	.word	0x9200		| data read/write
 	.word	0x00C0		| granularity=4096, 386
@@ -28,21 +28,29 @@ int block_write(int dev, long * pos, char * buf, int count)
 		count -= chars;
 		while (chars-->0)
 			*(p++) = get_fs_byte(buf++);
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		brelse(bh);
+		balance_dirty();
 	}
 	return written;
 }
 
-int block_read(int dev, unsigned long * pos, char * buf, int count)
+int block_read(int dev, struct file * filp, char * buf, int count)
 {
+	off_t * pos = &filp->f_pos;
 	int block = *pos / BLOCK_SIZE;
 	int offset = *pos % BLOCK_SIZE;
-	int chars;
+	int chars,end;
 	int read = 0;
 	struct buffer_head * bh;
 	register char * p;
 
+/* the driver ignores read-ahead past the end of the device */
+	end = (*pos+count+BLOCK_SIZE-1)/BLOCK_SIZE + reada_window(filp,count);
+	if (filp->f_raend < block)
+		filp->f_raend = block;
+	for ( ; filp->f_raend < end ; filp->f_raend++)
+		breada(dev,filp->f_raend);
 	while (count>0) {
 		bh = bread(dev,block);
 		if (!bh)
@@ -56,15 +64,14 @@ int block_read(int dev, unsigned long * pos, char * buf, int count)
 		count -= chars;
 		while (chars-->0)
 			put_fs_byte(*(p++),buf++);
-		bh->b_dirt = 1;
 		brelse(bh);
 	}
 	return read;
 }
 
-extern void rw_hd(int rw, struct buffer_head * bh);
+extern int rw_hd(int rw, struct buffer_head * bh);
 
-typedef void (*blk_fn)(int rw, struct buffer_head * bh);
+typedef int (*blk_fn)(int rw, struct buffer_head * bh);
 
 static blk_fn rd_blk[]={
 	NULL,		/* nodev */
@@ -75,12 +82,56 @@ static blk_fn rd_blk[]={
 	NULL,		/* dev tty */
 	NULL};		/* dev lp */
 
-void ll_rw_block(int rw, struct buffer_head * bh)
+/*
+ * ll_rw_block() returns -1 if the driver wouldn't take the buffer (it
+ * says why). A write it refused leaves the buffer dirty, but as newly
+ * dirtied, so that sync doesn't keep trying it. Swap's buffers aren't in
+ * the cache: they just aren't uptodate.
+ */
+int ll_rw_block(int rw, struct buffer_head * bh)
 {
 	blk_fn blk_addr;
 	unsigned int major;
 
 	if ((major=MAJOR(bh->b_dev)) >= NR_BLK_DEV || !(blk_addr=rd_blk[major]))
 		panic("Trying to read nonexistent block-device");
-	blk_addr(rw, bh);
+	if (rw == WRITE)
+		mark_buffer_clean(bh);
+	if (!blk_addr(rw, bh))
+		return 0;
+	if (bh->b_nocache)
+		bh->b_uptodate = 0;
+	else if (rw == WRITE)
+		mark_buffer_dirty(bh);
+	return -1;
+}
+
+/*
+ * ll_rw_blocks() queues a whole array of buffers and returns at once:
+ * the caller waits on them afterwards, so the driver gets to sort (and
+ * merge) them all before the first one is waited for. Buffers that are
+ * busy, already uptodate (read) or clean (write) are left alone. The
+ * driver may sleep waiting for a free request, so all of them are held
+ * meanwhile: else the cache could free those still to come. Returns the
+ * number of buffers queued.
+ */
+int ll_rw_blocks(int rw, int nr, struct buffer_head * bh[])
+{
+	struct buffer_head * tmp;
+	int i,queued = 0;
+
+	for (i=0 ; i<nr ; i++)
+		if (bh[i])
+			bh[i]->b_count++;
+	for (i=0 ; i<nr ; i++) {
+		if (!(tmp = bh[i]) || tmp->b_lock)
+			continue;
+		if (rw == WRITE ? tmp->b_dirt : !tmp->b_uptodate)
+			if (!ll_rw_block(rw,tmp))
+				queued++;
+	}
+	for (i=0 ; i<nr ; i++)
+		if (bh[i])
+			bh[i]->b_count--;	/* not brelse(), see breada() */
+	return queued;
 }
@@ -6,27 +6,24 @@
  * sleep-on-calls. These should be extremely quick, though (I hope).
  */
 
+#include <errno.h>
+
 #include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <asm/system.h>
 
-#if (BUFFER_END & 0xfff)
-#error "Bad BUFFER_END value"
-#endif
-
-#if (BUFFER_END > 0xA0000 && BUFFER_END <= 0x100000)
-#error "Bad BUFFER_END value"
-#endif
-
 extern int end;
+/* end of the static buffers: 0xA0000, or >= 0x100000 (see main()) */
+static unsigned long buffer_memory_end;
 struct buffer_head * start_buffer = (struct buffer_head *) &end;
-struct buffer_head * hash_table[NR_HASH];
+struct buffer_head ** hash_table;
+static int nr_hash, hash_shift;		/* nr_hash == 1<<(32-hash_shift) */
 static struct buffer_head * free_list;
-static struct task_struct * buffer_wait = NULL;
+static struct wait_queue * buffer_wait = NULL;
 int NR_BUFFERS = 0;
 
-static inline void wait_on_buffer(struct buffer_head * bh)
+void wait_on_buffer(struct buffer_head * bh)
 {
 	cli();
 	while (bh->b_lock)
@@ -34,40 +31,325 @@ static inline void wait_on_buffer(struct buffer_head * bh)
 	sti();
 }
 
+/*
+ * Dirty buffers are kept on a list per device, sorted by block number,
+ * so writing them out never needs a scan of the whole cache, and the
+ * disk gets them in order. A buffer is taken off its list (and marked
+ * clean) when the write is queued, not when it finishes: that way a
+ * buffer that is changed again while being written just goes back on
+ * the list. If the write fails, the disk interrupt puts it back on the
+ * list too, so the lists are changed with interrupts off.
+ */
+#define NR_DIRTY 16
+
+static struct {
+	int dev;
+	struct buffer_head * head;
+} dirty[NR_DIRTY];
+static int nr_dirty = 0;
+
+static struct buffer_head ** dirty_list(int dev)
+{
+	int i,free = -1;
+
+	for (i=0 ; i<NR_DIRTY ; i++)
+		if (dirty[i].head) {
+			if (dirty[i].dev == dev)
+				return &dirty[i].head;
+		} else if (free < 0)
+			free = i;
+	if (free < 0)
+		panic("Too many devices with dirty buffers");
+	dirty[free].dev = dev;
+	return &dirty[free].head;
+}
+
+void mark_buffer_dirty(struct buffer_head * bh)
+{
+	struct buffer_head ** p, * prev = NULL;
+	unsigned long flags;
+
+	if (bh->b_dirt)
+		return;
+	save_flags(flags);
+	cli();
+	bh->b_dirt = 1;
+	bh->b_dirtied = jiffies;
+	nr_dirty++;
+	for (p = dirty_list(bh->b_dev) ; *p ; p = &prev->b_next_dirty) {
+		if ((*p)->b_blocknr > bh->b_blocknr)
+			break;
+		prev = *p;
+	}
+	bh->b_prev_dirty = prev;
+	if (bh->b_next_dirty = *p)
+		bh->b_next_dirty->b_prev_dirty = bh;
+	*p = bh;
+	restore_flags(flags);
+}
+
+void mark_buffer_clean(struct buffer_head * bh)
+{
+	unsigned long flags;
+
+	if (!bh->b_dirt)
+		return;
+	save_flags(flags);
+	cli();
+	bh->b_dirt = 0;
+	nr_dirty--;
+	if (bh->b_next_dirty)
+		bh->b_next_dirty->b_prev_dirty = bh->b_prev_dirty;
+	if (bh->b_prev_dirty)
+		bh->b_prev_dirty->b_next_dirty = bh->b_next_dirty;
+	else
+		*dirty_list(bh->b_dev) = bh->b_next_dirty;
+	bh->b_prev_dirty = bh->b_next_dirty = NULL;
+	restore_flags(flags);
+}
+
+/*
+ * write_cluster() writes a dirty buffer along with the dirty buffers
+ * on either side of it, as long as the block numbers are contiguous.
+ */
+#define WRITE_CLUSTER 8
+
+static void write_cluster(struct buffer_head * bh)
+{
+	struct buffer_head * list[WRITE_CLUSTER];
+	int n;
+
+	for (n=1 ; n<WRITE_CLUSTER/2 && bh->b_prev_dirty ; n++) {
+		if (bh->b_prev_dirty->b_blocknr+1 != bh->b_blocknr)
+			break;
+		bh = bh->b_prev_dirty;
+	}
+	for (n=0 ; n<WRITE_CLUSTER ; bh = bh->b_next_dirty) {
+		list[n++] = bh;
+		if (!bh->b_next_dirty ||
+		    bh->b_next_dirty->b_blocknr != bh->b_blocknr+1)
+			break;
+	}
+	ll_rw_blocks(WRITE,n,list);
+}
+
+#define FLUSH_BATCH 32
+
+/*
+ * sys_sync() writes each dirty list FLUSH_BATCH buffers at a time, and
+ * waits for every batch before it goes on. Written buffers leave the
+ * list, so each batch is taken from the head again: after sleeping, the
+ * list may look different anyway. Buffers still busy with an earlier
+ * write are waited for and then written again. Only what was dirty when
+ * sync started is written: we'd never get done if others kept dirtying
+ * buffers behind us.
+ */
 int sys_sync(void)
 {
-	int i;
-	struct buffer_head * bh;
+	struct buffer_head * list[FLUSH_BATCH], * bh;
+	long start = jiffies;
+	int i,j,n,busy;
 
 	sync_inodes();		/* write out inodes into buffers */
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		wait_on_buffer(bh);
-		if (bh->b_dirt)
-			ll_rw_block(WRITE,bh);
+	for (i=0 ; i<NR_DIRTY ; i++) {
+repeat:
+		n = busy = 0;
+		for (bh = dirty[i].head ; bh && n<FLUSH_BATCH ;
+		     bh = bh->b_next_dirty)
+			if (bh->b_dirtied - start <= 0) {
+				busy |= bh->b_lock;
+				bh->b_count++;
+				list[n++] = bh;
+			}
+		if (!n)
+			continue;
+		for (j=0 ; j<n ; j++)
+			wait_on_buffer(list[j]);
+		if (ll_rw_blocks(WRITE,n,list))
+			busy = 1;
+		for (j=0 ; j<n ; j++)
+			brelse(list[j]);
+		if (busy)
+			goto repeat;
 	}
 	return 0;
 }
 
-static int sync_dev(int dev)
+/*
+ * bdflush is a process that never leaves the kernel: init starts it with
+ * bdflush(0,0). It wakes up every BDFLUSH_INTERVAL ticks, or when a writer
+ * finds too many dirty buffers, and writes out in block order everything
+ * that has been dirty too long - and anything else too, until at most
+ * half the dirty limit is left.
+ */
+static struct task_struct * bdflush_task = NULL;
+static struct wait_queue * bdflush_wait = NULL;
+static struct wait_queue * bdflush_done = NULL;
+static long bdf_age = BDFLUSH_AGE;
+static int bdf_ratio = BDFLUSH_RATIO;
+
+static void bdflush_pass(void)
 {
-	int i;
-	struct buffer_head * bh;
+	struct buffer_head * list[FLUSH_BATCH], * bh;
+	int i,n;
 
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		if (bh->b_dirt)
-			ll_rw_block(WRITE,bh);
+	for (i=0 ; i<NR_DIRTY ; i++) {
+repeat:
+		n = 0;
+		for (bh = dirty[i].head ; bh && n<FLUSH_BATCH ;
+		     bh = bh->b_next_dirty) {
+			if (bh->b_lock)
+				continue;
+			if (jiffies - bh->b_dirtied >= bdf_age ||
+			    nr_dirty-n > NR_BUFFERS*bdf_ratio/200)
+				list[n++] = bh;
+		}
+		if (n && ll_rw_blocks(WRITE,n,list))
+			goto repeat;
 	}
-	return 0;
 }
 
-#define _hashfn(dev,block) (((unsigned)(dev^block))%NR_HASH)
+/*
+ * Called by writers after dirtying a buffer: if too much of the cache
+ * is dirty, get bdflush going and wait for it to finish a pass.
+ */
+void balance_dirty(void)
+{
+	if (!bdflush_task || current == bdflush_task)
+		return;
+	if (nr_dirty <= NR_BUFFERS*bdf_ratio/100)
+		return;
+	wake_up(&bdflush_wait);
+	sleep_on(&bdflush_done);
+}
+
+/*
+ * bdflush(0,0) turns the caller into the daemon, and never returns.
+ * bdflush(1,secs) sets the age at which buffers are written, and
+ * bdflush(2,percent) the dirty ratio at which writers are throttled.
+ */
+int sys_bdflush(int func, long data)
+{
+	if (current->euid && current->uid)
+		return -EPERM;
+	switch (func) {
+		case 0:
+			if (bdflush_task)
+				return -EBUSY;
+			bdflush_task = current;
+			for (;;) {
+				bdflush_pass();
+				wake_up_all(&bdflush_done);
+				current->signal = 0;	/* we ignore signals */
+				set_alarm(jiffies + BDFLUSH_INTERVAL);
+				interruptible_sleep_on(&bdflush_wait);
+			}
+		case 1:
+			if (data <= 0)
+				return -EINVAL;
+			bdf_age = data*HZ;
+			return 0;
+		case 2:
+			if (data <= 0 || data > 100)
+				return -EINVAL;
+			bdf_ratio = data;
+			return 0;
+	}
+	return -EINVAL;
+}
+
+/*
+ * The hash multiplies (dev,block) by a number close to 2^32/phi and takes
+ * the top bits, so that neither runs of blocks nor different devices
+ * line up in the table.
+ */
+#define _hashfn(dev,block) \
+	(((((unsigned)(dev)<<16) ^ (unsigned)(block)) * 0x9E3779B1) >> hash_shift)
 #define hash(dev,block) hash_table[_hashfn(dev,block)]
 
+/*
+ * hash_stats() prints the average (over the chains in use) and the
+ * maximum hash chain length, in the style of calc_mem().
+ */
+void hash_stats(void)
+{
+	struct buffer_head * bh;
+	int i,n=0,used=0,total=0,max=0;
+
+	for (i=0 ; i<nr_hash ; i++) {
+		for (n=0,bh=hash_table[i] ; bh ; bh=bh->b_next)
+			n++;
+		if (n)
+			used++;
+		if (n > max)
+			max = n;
+		total += n;
+	}
+	if (used)
+		n = total*100/used;
+	printk("hash: %d buffers in %d of %d chains, avg %d.%02d, max %d\n\r",
+		total,used,nr_hash,n/100,n%100,max);
+}
+
+/*
+ * Buffer replacement is "2Q": a block that is read in goes on the
+ * probation list (free_list), which is plain FIFO. If it falls off the
+ * end of that, its number is remembered for a while in ghost[], and should
+ * it be wanted again in that time it comes back on the protected list
+ * (hot_list), which is LRU. Hits in the probation list don't count, as
+ * they are mostly small reads from the same block. This way one large
+ * sequential read only ever thrashes the probation list, and leaves the
+ * inode and directory blocks alone.
+ */
+static struct buffer_head * hot_list = NULL;
+static int nr_probation = 0;
+
+#define PROBATION_MIN (NR_BUFFERS/4)
+#define NR_GHOST 128
+
+static struct {
+	unsigned short dev;
+	unsigned short block;
+} ghost[NR_GHOST];
+static int ghost_next = 0;
+
+int buffer_hits = 0, buffer_misses = 0, buffer_ghost_hits = 0;
+
+#define lru_list(bh) (*((bh)->b_lru ? &hot_list : &free_list))
+
+static inline void remove_from_lru(struct buffer_head * bh)
+{
+	if (!(bh->b_prev_free) || !(bh->b_next_free))
+		panic("Free block list corrupted");
+	if (bh->b_next_free == bh)
+		lru_list(bh) = NULL;
+	else {
+		bh->b_prev_free->b_next_free = bh->b_next_free;
+		bh->b_next_free->b_prev_free = bh->b_prev_free;
+		if (lru_list(bh) == bh)
+			lru_list(bh) = bh->b_next_free;
+	}
+	if (!bh->b_lru)
+		nr_probation--;
+}
+
+/* put at end of the lru list */
+static inline void insert_into_lru(struct buffer_head * bh)
+{
+	struct buffer_head * head = lru_list(bh);
+
+	if (!head) {
+		bh->b_next_free = bh->b_prev_free = lru_list(bh) = bh;
+	} else {
+		bh->b_next_free = head;
+		bh->b_prev_free = head->b_prev_free;
+		head->b_prev_free->b_next_free = bh;
+		head->b_prev_free = bh;
+	}
+	if (!bh->b_lru)
+		nr_probation++;
+}
+
 static inline void remove_from_queues(struct buffer_head * bh)
 {
 /* remove from hash-queue */
@@ -77,22 +359,12 @@ static inline void remove_from_queues(struct buffer_head * bh)
 		bh->b_prev->b_next = bh->b_next;
 	if (hash(bh->b_dev,bh->b_blocknr) == bh)
 		hash(bh->b_dev,bh->b_blocknr) = bh->b_next;
-/* remove from free list */
-	if (!(bh->b_prev_free) || !(bh->b_next_free))
-		panic("Free block list corrupted");
-	bh->b_prev_free->b_next_free = bh->b_next_free;
-	bh->b_next_free->b_prev_free = bh->b_prev_free;
-	if (free_list == bh)
-		free_list = bh->b_next_free;
+	remove_from_lru(bh);
 }
 
 static inline void insert_into_queues(struct buffer_head * bh)
 {
-/* put at end of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
+	insert_into_lru(bh);
 /* put the buffer in new hash-queue if it has a device */
 	bh->b_prev = NULL;
 	bh->b_next = NULL;
@@ -100,7 +372,23 @@ static inline void insert_into_queues(struct buffer_head * bh)
 		return;
 	bh->b_next = hash(bh->b_dev,bh->b_blocknr);
 	hash(bh->b_dev,bh->b_blocknr) = bh;
-	bh->b_next->b_prev = bh;
+	if (bh->b_next)
+		bh->b_next->b_prev = bh;
+}
+
+/*
+ * Check the ghost list for a block being read in, removing it if found.
+ */
+static int find_ghost(int dev, int block)
+{
+	int i;
+
+	for (i=0 ; i<NR_GHOST ; i++)
+		if (ghost[i].dev==dev && ghost[i].block==block) {
+			ghost[i].dev = 0;
+			return 1;
+		}
+	return 0;
 }
 
 static struct buffer_head * find_buffer(int dev, int block)
@@ -133,9 +421,158 @@ repeat:
 		brelse(bh);
 		goto repeat;
 	}
+	if (bh->b_lru) {		/* protected: move to the mru end */
+		remove_from_lru(bh);
+		insert_into_lru(bh);
+	}
 	return bh;
 }
 
+/*
+ * Find an unused buffer to throw out: the oldest one on probation, unless
+ * the probation list is down to its minimum, in which case the least
+ * recently used protected one. A clean buffer that isn't busy is much
+ * better than one we'd have to write (or wait for) first, so we look a
+ * bit further for one of those - but not too far.
+ */
+#define VICTIM_SCAN 32
+
+static struct buffer_head * find_victim(void)
+{
+	struct buffer_head * list[2], * tmp, * busy = NULL;
+	int i,n;
+
+	list[0] = free_list;
+	list[1] = hot_list;
+	if (nr_probation <= PROBATION_MIN) {
+		list[0] = hot_list;
+		list[1] = free_list;
+	}
+	for (i=0 ; i<2 ; i++) {
+		if (!(tmp = list[i]))
+			continue;
+		n = 0;
+		do {
+			if (!tmp->b_count) {
+				if (!tmp->b_dirt && !tmp->b_lock)
+					return tmp;
+				if (!busy)
+					busy = tmp;
+				if (++n >= VICTIM_SCAN)
+					break;
+			}
+			tmp = tmp->b_next_free;
+		} while (tmp != list[i]);
+		if (busy)
+			return busy;
+	}
+	return NULL;
+}
+
+/*
+ * The buffers set up by buffer_init() are the minimum cache. Above that
+ * the cache grows a page (4 buffers) at a time with get_free_page() while
+ * there is plenty of free memory, and shrink_buffers() hands such pages
+ * back when memory runs low. The buffers of a page are linked through
+ * b_this_page. Their buffer heads come from kmalloc().
+ */
+#define dynamic_buffer(bh) ((unsigned long) (bh)->b_data >= buffer_memory_end)
+
+static void grow_buffers(void)
+{
+	struct buffer_head * heads[PAGE_SIZE/BLOCK_SIZE];
+	struct buffer_head * bh, * first = NULL;
+	unsigned long page;
+	int i;
+
+	for (i=0 ; i<PAGE_SIZE/BLOCK_SIZE ; i++)
+		if (!(heads[i] = kmalloc(sizeof (struct buffer_head)))) {
+			while (i-- > 0)
+				kfree(heads[i]);
+			return;
+		}
+	if (!(page = get_uncleared_page())) {
+		for (i=0 ; i<PAGE_SIZE/BLOCK_SIZE ; i++)
+			kfree(heads[i]);
+		return;
+	}
+	for (i=0 ; i<PAGE_SIZE/BLOCK_SIZE ; i++) {
+		bh = heads[i];
+		bh->b_dev = 0;
+		bh->b_blocknr = 0;
+		bh->b_dirt = 0;
+		bh->b_count = 0;
+		bh->b_lock = 0;
+		bh->b_uptodate = 0;
+		bh->b_wait = NULL;
+		bh->b_reqnext = NULL;
+		bh->b_lru = 0;
+		bh->b_prev_dirty = NULL;
+		bh->b_next_dirty = NULL;
+		bh->b_dirtied = 0;
+		bh->b_nocache = 0;
+		bh->b_data = (char *) (page + i*BLOCK_SIZE);
+		if (!(bh->b_this_page = first))
+			first = bh;
+		first->b_this_page = bh;
+		insert_into_queues(bh);
+		free_list = bh;		/* new buffers are used first */
+		NR_BUFFERS++;
+	}
+}
+
+/*
+ * Free the page of a dynamic buffer, if none of its buffers is in use.
+ */
+static int try_to_free(struct buffer_head * bh)
+{
+	struct buffer_head * tmp = bh;
+	unsigned long page;
+	int i;
+
+	if (!dynamic_buffer(bh))
+		return 0;
+	do {
+		if (tmp->b_count || tmp->b_dirt || tmp->b_lock)
+			return 0;
+		tmp = tmp->b_this_page;
+	} while (tmp != bh);
+	page = (unsigned long) bh->b_data & 0xfffff000;
+	for (i=0 ; i<PAGE_SIZE/BLOCK_SIZE ; i++) {
+		tmp = bh->b_this_page;
+		remove_from_queues(bh);
+		kfree(bh);
+		NR_BUFFERS--;
+		bh = tmp;
+	}
+	free_page(page);
+	return 1;
+}
+
+/*
+ * shrink_buffers() is called by get_free_page() when memory is low. It
+ * looks at the probation list first, and never sleeps.
+ */
+int shrink_buffers(int pages)
+{
+	struct buffer_head * bh;
+	int i,freed = 0;
+
+	for (i=0 ; i<2 && freed<pages ; i++) {
+repeat:
+		if (!(bh = i ? hot_list : free_list))
+			continue;
+		do {
+			if (try_to_free(bh) && ++freed<pages)
+				goto repeat;
+			if (freed >= pages)
+				break;
+			bh = bh->b_next_free;
+		} while (bh != (i ? hot_list : free_list));
+	}
+	return freed;
+}
+
 /*
  * Ok, this is getblk, and it isn't very clear, again to hinder
  * race-conditions. Most of the code is seldom used, (ie repeating),
@@ -146,48 +583,46 @@ struct buffer_head * getblk(int dev,int block)
 	struct buffer_head * tmp;
 
 repeat:
-	if (tmp=get_hash_table(dev,block))
+	if (tmp=get_hash_table(dev,block)) {
+		buffer_hits++;
 		return tmp;
-	tmp = free_list;
-	do {
-		if (!tmp->b_count) {
-			wait_on_buffer(tmp);	/* we still have to wait */
-			if (!tmp->b_count)	/* on it, it might be dirty */
-				break;
-		}
-		tmp = tmp->b_next_free;
-	} while (tmp != free_list || (tmp=NULL));
-	/* Kids, don't try THIS at home ^^^^^. Magic */
-	if (!tmp) {
+	}
+	if (nr_free_pages > FREE_PAGES_HIGH)
+		grow_buffers();
+	if (!(tmp = find_victim())) {
 		printk("Sleeping on free buffer ..");
-		sleep_on(&buffer_wait);
+		sleep_on_exclusive(&buffer_wait);
 		printk("ok\n");
 		goto repeat;
 	}
-	tmp->b_count++;
-	remove_from_queues(tmp);
 /*
- * Now, when we know nobody can get to this node (as it's removed from the
- * free list), we write it out. We can sleep here without fear of race-
- * conditions.
+ * If the buffer has to be written out (or is being written/read), do
+ * that and then start all over again: we have slept, so anything can
+ * have happened. Once we get past this, we don't sleep any more.
  */
-	if (tmp->b_dirt)
-		sync_dev(tmp->b_dev);
+	if (tmp->b_dirt || tmp->b_lock) {
+		tmp->b_count++;		/* so it isn't freed while we sleep */
+		if (tmp->b_dirt)
+			write_cluster(tmp);
+		wait_on_buffer(tmp);
+		tmp->b_count--;
+		goto repeat;
+	}
+	tmp->b_count++;
+	remove_from_queues(tmp);
+/* remember what was thrown off the probation list */
+	if (!tmp->b_lru && tmp->b_dev) {
+		ghost[ghost_next].dev = tmp->b_dev;
+		ghost[ghost_next].block = tmp->b_blocknr;
+		ghost_next = (ghost_next+1) % NR_GHOST;
+	}
 /* update buffer contents */
 	tmp->b_dev=dev;
 	tmp->b_blocknr=block;
-	tmp->b_dirt=0;
 	tmp->b_uptodate=0;
-/* NOTE!! While we possibly slept in sync_dev(), somebody else might have
- * added "this" block already, so check for that. Thank God for goto's.
- */
-	if (find_buffer(dev,block)) {
-		tmp->b_dev=0;		/* ok, someone else has beaten us */
-		tmp->b_blocknr=0;	/* to it - free this block and */
-		tmp->b_count=0;		/* try again */
-		insert_into_queues(tmp);
-		goto repeat;
-	}
+	buffer_misses++;
+	if (tmp->b_lru = find_ghost(dev,block))
+		buffer_ghost_hits++;
 /* and then insert into correct position */
 	insert_into_queues(tmp);
 	return tmp;
@@ -200,7 +635,8 @@ void brelse(struct buffer_head * buf)
 	wait_on_buffer(buf);
 	if (!(buf->b_count--))
 		panic("Trying to free free buffer");
-	wake_up(&buffer_wait);
+	if (!buf->b_count)		/* one more buffer for getblk */
+		wake_up(&buffer_wait);
 }
 
 /*
@@ -216,18 +652,95 @@ struct buffer_head * bread(int dev,int block)
 	if (bh->b_uptodate)
 		return bh;
 	ll_rw_block(READ,bh);
+	wait_on_buffer(bh);
 	if (bh->b_uptodate)
 		return bh;
 	brelse(bh);
 	return (NULL);
 }
 
-void buffer_init(void)
+/*
+ * breada() starts reading a block into the cache, but doesn't wait for
+ * it. It's meant for read-ahead, so nothing is done if the block is in
+ * the cache already, and the request may be dropped by the driver.
+ */
+void breada(int dev,int block)
 {
-	struct buffer_head * h = start_buffer;
-	void * b = (void *) BUFFER_END;
+	struct buffer_head * bh;
+
+	if (find_buffer(dev,block))
+		return;
+	if (!(bh=getblk(dev,block)))
+		panic("breada: getblk returned NULL\n");
+	if (!bh->b_uptodate)
+		ll_rw_block(READA,bh);
+	bh->b_count--;		/* not brelse(), it would wait for the read */
+}
+
+#define COPYBLK(from,to) \
+__asm__("cld\n\t" \
+	"rep\n\t" \
+	"movsl\n\t" \
+	::"c" (BLOCK_SIZE/4),"S" (from),"D" (to) \
+	:"cx","di","si")
+
+/*
+ * bread_page() reads four blocks into a page of memory (which must be
+ * cleared already, as block number 0 means a hole). All four are queued
+ * before we wait for any of them. It returns -1 if any of them couldn't
+ * be read, 0 if all went well.
+ */
+int bread_page(unsigned long address,int dev,int b[4])
+{
+	struct buffer_head * bh[4];
+	int i,error = 0;
+
+	for (i=0 ; i<4 ; i++)
+		bh[i] = b[i] ? getblk(dev,b[i]) : NULL;
+	ll_rw_blocks(READ,4,bh);
+	for (i=0 ; i<4 ; i++,address += BLOCK_SIZE)
+		if (bh[i]) {
+			wait_on_buffer(bh[i]);
+			if (bh[i]->b_uptodate)
+				COPYBLK((unsigned long) bh[i]->b_data,address);
+			else
+				error = -1;
+			brelse(bh[i]);
+		}
+	return error;
+}
+
+/*
+ * The hash table goes first in the buffer memory, followed by the buffer
+ * heads. It gets one entry per buffer the cache can ever have, rounded up
+ * to a power of two: the static ones here, plus those grow_buffers() can
+ * add in all but FREE_PAGES_HIGH pages of main memory. That way it never
+ * needs rehashing as the cache grows.
+ */
+void buffer_init(long buffer_end, long memory_end)
+{
+	struct buffer_head * h;
+	void * b;
+	long mem,pages;
 	int i;
 
+	buffer_memory_end = buffer_end;
+	b = (void *) buffer_end;
+	mem = buffer_end - (long) &end;
+	if (buffer_end > 0x100000)
+		mem -= 0x100000 - 0xA0000;
+	mem /= BLOCK_SIZE + sizeof (struct buffer_head);
+	pages = (memory_end - (buffer_end > 0x100000 ? buffer_end : 0x100000)) >> 12;
+	if (pages > FREE_PAGES_HIGH)
+		mem += (pages - FREE_PAGES_HIGH) * (PAGE_SIZE/BLOCK_SIZE);
+	for (nr_hash = MIN_HASH, hash_shift = 32 ; nr_hash < mem ; nr_hash <<= 1)
+		;
+	for (i = nr_hash ; i > 1 ; i >>= 1)
+		hash_shift--;
+	hash_table = (struct buffer_head **) &end;
+	for (i=0;i<nr_hash;i++)
+		hash_table[i]=NULL;
+	start_buffer = h = (struct buffer_head *) (hash_table + nr_hash);
 	while ( (b -= BLOCK_SIZE) >= ((void *) (h+1)) ) {
 		h->b_dev = 0;
 		h->b_dirt = 0;
@@ -237,6 +750,13 @@ void buffer_init(void)
 		h->b_wait = NULL;
 		h->b_next = NULL;
 		h->b_prev = NULL;
+		h->b_reqnext = NULL;
+		h->b_lru = 0;
+		h->b_prev_dirty = NULL;
+		h->b_next_dirty = NULL;
+		h->b_dirtied = 0;
+		h->b_this_page = NULL;
+		h->b_nocache = 0;
 		h->b_data = (char *) b;
 		h->b_prev_free = h-1;
 		h->b_next_free = h+1;
@@ -249,6 +769,27 @@ void buffer_init(void)
 	free_list = start_buffer;
 	free_list->b_prev_free = h;
 	h->b_next_free = free_list;
-	for (i=0;i<NR_HASH;i++)
-		hash_table[i]=NULL;
+	nr_probation = NR_BUFFERS;
+}
+
+void buffer_stats(void)
+{
+	int i,used=0,dyn=0;
+	struct buffer_head * bh;
+
+	for (i=0 ; i<2 ; i++) {
+		if (!(bh = i ? hot_list : free_list))
+			continue;
+		do {
+			if (bh->b_count) used++;
+			if (dynamic_buffer(bh)) dyn++;
+			bh = bh->b_next_free;
+		} while (bh != (i ? hot_list : free_list));
+	}
+	printk("%d buffers (%d dynamic): %d protected, %d on probation, "
+		"%d in use\n\r",NR_BUFFERS,dyn,NR_BUFFERS-nr_probation,
+		nr_probation,used);
+	printk("%d hits, %d misses (%d ghost hits)\n\r",
+		buffer_hits,buffer_misses,buffer_ghost_hits);
+	hash_stats();
 }	
@@ -7,10 +7,15 @@
 #include <linux/kernel.h>
 #include <linux/mm.h>
 #include <asm/segment.h>
+#include <asm/system.h>
 
 extern int sys_exit(int exit_code);
 extern int sys_close(int fd);
 
+/* exec and spawn latency, in timer_ticks() */
+static unsigned long nr_execs = 0, exec_time = 0;
+static unsigned long nr_spawns = 0, spawn_time = 0;
+
 /*
  * MAX_ARG_PAGES defines the number of pages allocated for arguments
  * and envelope for the new program. 32 should suffice, this gives
@@ -18,125 +23,73 @@ extern int sys_close(int fd);
  */
 #define MAX_ARG_PAGES 32
 
-#define cp_block(from,to) \
-__asm__("pushl $0x10\n\t" \
-	"pushl $0x17\n\t" \
-	"pop %%es\n\t" \
-	"cld\n\t" \
-	"rep\n\t" \
-	"movsl\n\t" \
-	"pop %%es" \
-	::"c" (BLOCK_SIZE/4),"S" (from),"D" (to) \
-	:"cx","di","si")
+/* where the argument pages end up: at the top of the data segment */
+#define ARG_BASE (TASK_SIZE-MAX_ARG_PAGES*PAGE_SIZE)
 
-/*
- * read_head() reads blocks 1-6 (not 0). Block 0 has already been
- * read for header information.
- */
-int read_head(struct m_inode * inode,int blocks)
+static inline char arg_byte(unsigned long * page,unsigned long p)
 {
-	struct buffer_head * bh;
-	int count;
-
-	if (blocks>6)
-		blocks=6;
-	for(count = 0 ; count<blocks ; count++) {
-		if (!inode->i_zone[count+1])
-			continue;
-		if (!(bh=bread(inode->i_dev,inode->i_zone[count+1])))
-			return -1;
-		cp_block(bh->b_data,count*BLOCK_SIZE);
-		brelse(bh);
-	}
-	return 0;
-}
-
-int read_ind(int dev,int ind,long size,unsigned long offset)
-{
-	struct buffer_head * ih, * bh;
-	unsigned short * table,block;
-
-	if (size<=0)
-		panic("size<=0 in read_ind");
-	if (size>512*BLOCK_SIZE)
-		size=512*BLOCK_SIZE;
-	if (!ind)
-		return 0;
-	if (!(ih=bread(dev,ind)))
-		return -1;
-	table = (unsigned short *) ih->b_data;
-	while (size>0) {
-		if (block=*(table++))
-			if (!(bh=bread(dev,block))) {
-				brelse(ih);
-				return -1;
-			} else {
-				cp_block(bh->b_data,offset);
-				brelse(bh);
-			}
-		size -= BLOCK_SIZE;
-		offset += BLOCK_SIZE;
-	}
-	brelse(ih);
-	return 0;
+	return ((char *) page[p/PAGE_SIZE])[p%PAGE_SIZE];
 }
 
 /*
- * read_area() reads an area into %fs:mem.
+ * put_arg_long() stores a long at offset p in the argument pages,
+ * getting the page if the strings didn't need it.
  */
-int read_area(struct m_inode * inode,long size)
+static int put_arg_long(unsigned long val,unsigned long * page,
+	unsigned long p)
 {
-	struct buffer_head * dind;
-	unsigned short * table;
-	int i,count;
-
-	if ((i=read_head(inode,(size+BLOCK_SIZE-1)/BLOCK_SIZE)) ||
-	    (size -= BLOCK_SIZE*6)<=0)
-		return i;
-	if ((i=read_ind(inode->i_dev,inode->i_zone[7],size,BLOCK_SIZE*6)) ||
-	    (size -= BLOCK_SIZE*512)<=0)
-		return i;
-	if (!(i=inode->i_zone[8]))
-		return 0;
-	if (!(dind = bread(inode->i_dev,i)))
+	if (!page[p/PAGE_SIZE] && !(page[p/PAGE_SIZE] = get_free_page()))
 		return -1;
-	table = (unsigned short *) dind->b_data;
-	for(count=0 ; count<512 ; count++)
-		if ((i=read_ind(inode->i_dev,*(table++),size,
-		    BLOCK_SIZE*(518+count))) || (size -= BLOCK_SIZE*512)<=0)
-			return i;
-	panic("Impossibly long executable");
+	*(unsigned long *) (page[p/PAGE_SIZE] + p%PAGE_SIZE) = val;
+	return 0;
 }
 
 /*
- * create_tables() parses the env- and arg-strings in new user
- * memory and creates the pointer tables from them, and puts their
- * addresses on the "stack", returning the new stack pointer value.
+ * create_tables() parses the env- and arg-strings in the argument
+ * pages and creates the pointer tables from them, and puts their
+ * addresses on the "stack", returning the new stack pointer value
+ * (or -E2BIG/-ENOMEM). This is done before the pages are mapped, so
+ * that exec can still fail, and spawn can do it for another task.
  */
-static unsigned long * create_tables(char * p,int argc,int envc)
+static long create_tables(unsigned long * page,unsigned long p,
+	int argc,int envc)
 {
-	unsigned long *argv,*envp;
-	unsigned long * sp;
+	unsigned long argv,envp;
+	unsigned long sp;
 
-	sp = (unsigned long *) (0xfffffffc & (unsigned long) p);
-	sp -= envc+1;
+	sp = 0xfffffffc & p;
+	if (sp < 4*(envc+argc+5))
+		return -E2BIG;
+	sp -= 4*(envc+1);
 	envp = sp;
-	sp -= argc+1;
+	sp -= 4*(argc+1);
 	argv = sp;
-	put_fs_long((unsigned long)envp,--sp);
-	put_fs_long((unsigned long)argv,--sp);
-	put_fs_long((unsigned long)argc,--sp);
+	sp -= 12;
+	if (put_arg_long(ARG_BASE+envp,page,sp+8) ||
+	    put_arg_long(ARG_BASE+argv,page,sp+4) ||
+	    put_arg_long(argc,page,sp))
+		return -ENOMEM;
 	while (argc-->0) {
-		put_fs_long((unsigned long) p,argv++);
-		while (get_fs_byte(p++)) /* nothing */ ;
+		if (put_arg_long(ARG_BASE+p,page,argv))
+			return -ENOMEM;
+		argv += 4;
+		while (arg_byte(page,p))
+			p++;
+		p++;
 	}
-	put_fs_long(0,argv);
+	if (put_arg_long(0,page,argv))
+		return -ENOMEM;
 	while (envc-->0) {
-		put_fs_long((unsigned long) p,envp++);
-		while (get_fs_byte(p++)) /* nothing */ ;
+		if (put_arg_long(ARG_BASE+p,page,envp))
+			return -ENOMEM;
+		envp += 4;
+		while (arg_byte(page,p))
+			p++;
+		p++;
 	}
-	put_fs_long(0,envp);
-	return sp;
+	if (put_arg_long(0,page,envp))
+		return -ENOMEM;
+	return ARG_BASE+sp;
 }
 
 /*
@@ -157,9 +110,10 @@ static int count(char ** argv)
 /*
  * 'copy_string()' copies argument/envelope strings from user
  * memory to free pages in kernel mem. These are in a format ready
- * to be put directly into the top of new user memory.
+ * to be put directly into the top of new user memory. Returns the new
+ * offset, or -E2BIG/-ENOMEM.
  */
-static unsigned long copy_strings(int argc,char ** argv,unsigned long *page,
+static long copy_strings(int argc,char ** argv,unsigned long *page,
 		unsigned long p)
 {
 	int len,i;
@@ -172,12 +126,12 @@ static unsigned long copy_strings(int argc,char ** argv,unsigned long *page,
 		do {
 			len++;
 		} while (get_fs_byte(tmp++));
-		if (p-len < 0)		/* this shouldn't happen - 128kB */
-			return 0;
+		if (p < len)		/* this shouldn't happen - 128kB */
+			return -E2BIG;
 		i = ((unsigned) (p-len)) >> 12;
 		while (i<MAX_ARG_PAGES && !page[i]) {
 			if (!(page[i]=get_free_page()))
-				return 0;
+				return -ENOMEM;
 			i++;
 		}
 		do {
@@ -191,48 +145,43 @@ static unsigned long copy_strings(int argc,char ** argv,unsigned long *page,
 	return p;
 }
 
-static unsigned long change_ldt(unsigned long text_size,unsigned long * page)
+static unsigned long change_ldt(struct task_struct * p,
+	unsigned long text_size,unsigned long * page)
 {
 	unsigned long code_limit,data_limit,code_base,data_base;
 	int i;
 
 	code_limit = text_size+PAGE_SIZE -1;
 	code_limit &= 0xFFFFF000;
-	data_limit = 0x4000000;
-	code_base = get_base(current->ldt[1]);
+	data_limit = TASK_SIZE;
+	code_base = TASK_BASE;
 	data_base = code_base;
-	set_base(current->ldt[1],code_base);
-	set_limit(current->ldt[1],code_limit);
-	set_base(current->ldt[2],data_base);
-	set_limit(current->ldt[2],data_limit);
+	set_base(p->ldt[1],code_base);
+	set_limit(p->ldt[1],code_limit);
+	set_base(p->ldt[2],data_base);
+	set_limit(p->ldt[2],data_limit);
 /* make sure fs points to the NEW data segment */
-	__asm__("pushl $0x17\n\tpop %%fs"::);
+	if (p == current)
+		__asm__("pushl $0x17\n\tpop %%fs"::);
 	data_base += data_limit;
 	for (i=MAX_ARG_PAGES-1 ; i>=0 ; i--) {
 		data_base -= PAGE_SIZE;
 		if (page[i])
-			put_page(page[i],data_base);
+			put_task_page(p,page[i],data_base);
 	}
 	return data_limit;
 }
 
 /*
- * 'do_execve()' executes a new program.
+ * open_exec() finds the executable, checks that we may run it and
+ * reads its header. It's the part of exec that spawn shares.
  */
-int do_execve(unsigned long * eip,long tmp,char * filename,
-	char ** argv, char ** envp)
+static int open_exec(char * filename,struct m_inode ** res,struct exec * ex)
 {
 	struct m_inode * inode;
 	struct buffer_head * bh;
-	struct exec ex;
-	unsigned long page[MAX_ARG_PAGES];
-	int i,argc,envc;
-	unsigned long p;
+	int i;
 
-	if ((0xffff & eip[1]) != 0x000f)
-		panic("execve called from supervisor mode");
-	for (i=0 ; i<MAX_ARG_PAGES ; i++)	/* clear page-table */
-		page[i]=0;
 	if (!(inode=namei(filename)))		/* get executables inode */
 		return -ENOENT;
 	if (!S_ISREG(inode->i_mode)) {	/* must be regular file */
@@ -255,25 +204,65 @@ int do_execve(unsigned long * eip,long tmp,char * filename,
 		iput(inode);
 		return -EACCES;
 	}
-	ex = *((struct exec *) bh->b_data);	/* read exec-header */
+	*ex = *((struct exec *) bh->b_data);	/* read exec-header */
 	brelse(bh);
-	if (N_MAGIC(ex) != ZMAGIC || ex.a_trsize || ex.a_drsize ||
-		ex.a_text+ex.a_data+ex.a_bss>0x3000000 ||
-		inode->i_size < ex.a_text+ex.a_data+ex.a_syms+N_TXTOFF(ex)) {
+	if (N_MAGIC(*ex) != ZMAGIC || ex->a_trsize || ex->a_drsize ||
+		ex->a_text+ex->a_data+ex->a_bss>0x3000000 ||
+		inode->i_size < ex->a_text+ex->a_data+ex->a_syms+N_TXTOFF(*ex)) {
 		iput(inode);
 		return -ENOEXEC;
 	}
-	if (N_TXTOFF(ex) != BLOCK_SIZE)
+	if (N_TXTOFF(*ex) != BLOCK_SIZE)
 		panic("N_TXTOFF != BLOCK_SIZE. See a.out.h.");
+	*res = inode;
+	return 0;
+}
+
+/*
+ * copy_args() copies the strings to the argument pages and makes the
+ * tables, returning the new stack pointer, or -E2BIG if they don't fit
+ * and -ENOMEM if there are no free pages (with the pages freed).
+ */
+static long copy_args(char ** argv,char ** envp,unsigned long * page)
+{
+	int i,argc,envc;
+	long p;
+
+	for (i=0 ; i<MAX_ARG_PAGES ; i++)	/* clear page-table */
+		page[i]=0;
 	argc = count(argv);
 	envc = count(envp);
 	p = copy_strings(envc,envp,page,PAGE_SIZE*MAX_ARG_PAGES-4);
-	p = copy_strings(argc,argv,page,p);
-	if (!p) {
+	if (p >= 0)
+		p = copy_strings(argc,argv,page,p);
+	if (p >= 0)
+		p = create_tables(page,p,argc,envc);
+	if (p < 0)
 		for (i=0 ; i<MAX_ARG_PAGES ; i++)
 			free_page(page[i]);
+	return p;
+}
+
+/*
+ * 'do_execve()' executes a new program.
+ */
+int do_execve(unsigned long * eip,long tmp,char * filename,
+	char ** argv, char ** envp)
+{
+	struct m_inode * inode;
+	struct exec ex;
+	unsigned long page[MAX_ARG_PAGES];
+	int i;
+	long p;
+	unsigned long start = timer_ticks();
+
+	if ((0xffff & eip[1]) != 0x000f)
+		panic("execve called from supervisor mode");
+	if (i = open_exec(filename,&inode,&ex))
+		return i;
+	if ((p = copy_args(argv,envp,page)) < 0) {
 		iput(inode);
-		return -1;
+		return p;
 	}
 /* OK, This is the point of no return */
 	for (i=0 ; i<32 ; i++)
@@ -282,25 +271,104 @@ int do_execve(unsigned long * eip,long tmp,char * filename,
 		if ((current->close_on_exec>>i)&1)
 			sys_close(i);
 	current->close_on_exec = 0;
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	free_page_tables(current,get_base(current->ldt[1]),get_limit(0x0f));
+	free_page_tables(current,get_base(current->ldt[2]),get_limit(0x17));
+/* not before: share_page() mustn't find the old program's pages */
+	iput(current->executable);
+	current->executable = inode;
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
 	current->used_math = 0;
-	p += change_ldt(ex.a_text,page)-MAX_ARG_PAGES*PAGE_SIZE;
-	p = (unsigned long) create_tables((char *)p,argc,envc);
+	change_ldt(current,ex.a_text,page);
 	current->brk = ex.a_bss +
 		(current->end_data = ex.a_data +
 		(current->end_code = ex.a_text));
 	current->start_stack = p & 0xfffff000;
-	i = read_area(inode,ex.a_text+ex.a_data);
-	iput(inode);
-	if (i<0)
-		sys_exit(-1);
-	i = ex.a_text+ex.a_data;
-	while (i&0xfff)
-		put_fs_byte(0,(char *) (i++));
 	eip[0] = ex.a_entry;		/* eip, magic happens :-) */
 	eip[3] = p;			/* stack pointer */
+	nr_execs++;
+	exec_time += timer_ticks() - start;
 	return 0;
 }
+
+/*
+ * do_spawn() is fork+exec in one: it makes a new task that starts out
+ * running 'filename', without ever copying the page tables of the
+ * current one. Only the open files in 'fdmask' (bit n for fd n) are
+ * passed on, and close-on-exec ones never are. Returns the new pid.
+ */
+int do_spawn(char * filename,char ** argv,char ** envp,long fdmask)
+{
+	struct task_struct * p;
+	struct m_inode * inode;
+	struct exec ex;
+	unsigned long page[MAX_ARG_PAGES];
+	int i,nr;
+	long sp;
+	unsigned long start = timer_ticks();
+
+	if (i = open_exec(filename,&inode,&ex))
+		return i;
+	if ((sp = copy_args(argv,envp,page)) < 0) {
+		iput(inode);
+		return sp;
+	}
+	if ((nr = find_empty_process()) < 0 || !(p = copy_task(nr))) {
+		for (i=0 ; i<MAX_ARG_PAGES ; i++)
+			free_page(page[i]);
+		iput(inode);
+		return -EAGAIN;
+	}
+	p->executable = inode;
+	for (i=0 ; i<32 ; i++)
+		p->sig_fn[i] = NULL;
+	for (i=0 ; i<NR_OPEN ; i++)
+		if (!((fdmask>>i)&1) || ((current->close_on_exec>>i)&1))
+			p->filp[i] = NULL;
+		else if (p->filp[i])
+			p->filp[i]->f_count++;
+	p->close_on_exec = 0;
+	if (p->pwd)
+		p->pwd->i_count++;
+	if (p->root)
+		p->root->i_count++;
+	p->used_math = 0;
+	change_ldt(p,ex.a_text,page);
+	p->brk = ex.a_bss +
+		(p->end_data = ex.a_data +
+		(p->end_code = ex.a_text));
+	p->start_stack = sp & 0xfffff000;
+	p->tss.eip = ex.a_entry;
+	p->tss.esp = sp;
+	p->tss.eflags = 0x200;		/* interrupts on */
+	p->tss.eax = p->tss.ebx = p->tss.ecx = p->tss.edx = 0;
+	p->tss.esi = p->tss.edi = p->tss.ebp = 0;
+	p->tss.cs = 0x0f;
+	p->tss.ds = p->tss.es = p->tss.fs = p->tss.gs = p->tss.ss = 0x17;
+	set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY,&(p->tss));
+	set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&(p->ldt));
+	task[nr] = p;	/* do this last, just in case */
+	wake_up_process(p);
+	nr_spawns++;
+	spawn_time += timer_ticks() - start;
+	return p->pid;
+}
+
+/*
+ * spawn_stats() compares the cost of spawn with that of fork+exec. Not
+ * called from anywhere: it's for debugging, like calc_mem().
+ */
+void spawn_stats(void)
+{
+	extern unsigned long nr_forks, fork_time;
+
+	if (nr_forks)
+		printk("%d forks, %d timer ticks each\n\r",
+			nr_forks,fork_time/nr_forks);
+	if (nr_execs)
+		printk("%d execs, %d timer ticks each\n\r",
+			nr_execs,exec_time/nr_execs);
+	if (nr_spawns)
+		printk("%d spawns, %d timer ticks each\n\r",
+			nr_spawns,spawn_time/nr_spawns);
+}
@@ -8,13 +8,27 @@
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
+/*
+ * file_read() first queues all the blocks it needs, plus those in the
+ * read-ahead window of the file, and only then starts waiting for them.
+ * That way the disk gets the whole lot in one go, sorted and merged.
+ */
 int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
-	int left,chars,nr;
+	int left,chars,nr,end;
 	struct buffer_head * bh;
 
 	if ((left=count)<=0)
 		return 0;
+	end = (filp->f_pos+count+BLOCK_SIZE-1)/BLOCK_SIZE +
+		reada_window(filp,count);
+	if (end > (nr=(inode->i_size+BLOCK_SIZE-1)/BLOCK_SIZE))
+		end = nr;
+	if (filp->f_raend < filp->f_pos/BLOCK_SIZE)
+		filp->f_raend = filp->f_pos/BLOCK_SIZE;
+	for ( ; filp->f_raend < end ; filp->f_raend++)
+		if (nr = bmap(inode,filp->f_raend))
+			breada(inode->i_dev,nr);
 	while (left) {
 		if (nr = bmap(inode,(filp->f_pos)/BLOCK_SIZE)) {
 			if (!(bh=bread(inode->i_dev,nr)))
@@ -62,7 +76,6 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 			break;
 		c = pos % BLOCK_SIZE;
 		p = c + bh->b_data;
-		bh->b_dirt = 1;
 		c = BLOCK_SIZE-c;
 		if (c > count-i) c = count-i;
 		pos += c;
@@ -73,7 +86,10 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 		i += c;
 		while (c-->0)
 			*(p++) = get_fs_byte(buf++);
+/* after the copy, which can sleep: bdflush mustn't write half of it */
+		mark_buffer_dirty(bh);
 		brelse(bh);
+		balance_dirty();
 	}
 	inode->i_mtime = CURRENT_TIME;
 	if (!(filp->f_flags & O_APPEND)) {
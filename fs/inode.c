@@ -22,7 +22,7 @@ static inline void lock_inode(struct m_inode * inode)
 {
 	cli();
 	while (inode->i_lock)
-		sleep_on(&inode->i_wait);
+		sleep_on_exclusive(&inode->i_wait);
 	inode->i_lock=1;
 	sti();
 }
@@ -78,7 +78,7 @@ static int _bmap(struct m_inode * inode,int block,int create)
 		if (create && !i)
 			if (i=new_block(inode->i_dev)) {
 				((unsigned short *) (bh->b_data))[block]=i;
-				bh->b_dirt=1;
+				mark_buffer_dirty(bh);
 			}
 		brelse(bh);
 		return i;
@@ -97,7 +97,7 @@ static int _bmap(struct m_inode * inode,int block,int create)
 	if (create && !i)
 		if (i=new_block(inode->i_dev)) {
 			((unsigned short *) (bh->b_data))[block>>9]=i;
-			bh->b_dirt=1;
+			mark_buffer_dirty(bh);
 		}
 	brelse(bh);
 	if (!i)
@@ -108,7 +108,7 @@ static int _bmap(struct m_inode * inode,int block,int create)
 	if (create && !i)
 		if (i=new_block(inode->i_dev)) {
 			((unsigned short *) (bh->b_data))[block&511]=i;
-			bh->b_dirt=1;
+			mark_buffer_dirty(bh);
 		}
 	brelse(bh);
 	return i;
@@ -132,7 +132,7 @@ void iput(struct m_inode * inode)
 	if (!inode->i_count)
 		panic("iput: trying to free free inode");
 	if (inode->i_pipe) {
-		wake_up(&inode->i_wait);
+		wake_up_all(&inode->i_wait);
 		if (--inode->i_count)
 			return;
 		free_page(inode->i_size);
@@ -205,7 +205,7 @@ struct m_inode * get_pipe_inode(void)
 
 	if (!(inode = get_empty_inode()))
 		return NULL;
-	if (!(inode->i_size=get_free_page())) {
+	if (!(inode->i_size=get_uncleared_page())) {
 		inode->i_count = 0;
 		return NULL;
 	}
@@ -281,7 +281,7 @@ static void write_inode(struct m_inode * inode)
 	((struct d_inode *)bh->b_data)
 		[(inode->i_num-1)%INODES_PER_BLOCK] =
 			*(struct d_inode *)inode;
-	bh->b_dirt=1;
+	mark_buffer_dirty(bh);
 	inode->i_dirt=0;
 	brelse(bh);
 	unlock_inode(inode);
@@ -1,6 +1,7 @@
 #include <signal.h>
 
 #include <linux/sched.h>
+#include <linux/kernel.h>
 #include <linux/mm.h>	/* for get_free_page */
 #include <asm/segment.h>
 
@@ -12,7 +13,7 @@ int read_pipe(struct m_inode * inode, char * buf, int count)
 		wake_up(&inode->i_wait);
 		if (inode->i_count != 2) /* are there any writers left? */
 			return 0;
-		sleep_on(&inode->i_wait);
+		sleep_on_exclusive(&inode->i_wait);
 	}
 	while (count>0 && !(PIPE_EMPTY(*inode))) {
 		count --;
@@ -39,7 +40,7 @@ int write_pipe(struct m_inode * inode, char * buf, int count)
 				current->signal |= (1<<(SIGPIPE-1));
 				return b-buf;
 			}
-			sleep_on(&inode->i_wait);
+			sleep_on_exclusive(&inode->i_wait);
 		}
 		((char *)inode->i_size)[PIPE_HEAD(*inode)] = get_fs_byte(b++);
 		INC_PIPE( PIPE_HEAD(*inode) );
@@ -86,6 +87,7 @@ int sys_pipe(unsigned long * fildes)
 	f[0]->f_pos = f[1]->f_pos = 0;
 	f[0]->f_mode = 1;		/* read */
 	f[1]->f_mode = 2;		/* write */
+	verify_area(fildes,8);
 	put_fs_long(fd[0],0+fildes);
 	put_fs_long(fd[1],1+fildes);
 	return 0;
@@ -9,7 +9,7 @@
 extern int rw_char(int rw,int dev, char * buf, int count);
 extern int read_pipe(struct m_inode * inode, char * buf, int count);
 extern int write_pipe(struct m_inode * inode, char * buf, int count);
-extern int block_read(int dev, off_t * pos, char * buf, int count);
+extern int block_read(int dev, struct file * filp, char * buf, int count);
 extern int block_write(int dev, off_t * pos, char * buf, int count);
 extern int file_read(struct m_inode * inode, struct file * filp,
 		char * buf, int count);
@@ -46,6 +46,24 @@ int sys_lseek(unsigned int fd,off_t offset, int origin)
 	return file->f_pos;
 }
 
+/*
+ * reada_window() is called by the block-reading routines before a read.
+ * A read that starts where the last one ended doubles the read-ahead
+ * window of the file, anything else means a seek and closes it again.
+ */
+int reada_window(struct file * filp, int count)
+{
+	if (filp->f_pos != filp->f_rapos) {
+		filp->f_reada = 0;
+		filp->f_raend = 0;
+	} else if (!filp->f_reada)
+		filp->f_reada = READA_MIN;
+	else if (filp->f_reada < READA_MAX)
+		filp->f_reada <<= 1;
+	filp->f_rapos = filp->f_pos + count;
+	return filp->f_reada;
+}
+
 int sys_read(unsigned int fd,char * buf,int count)
 {
 	struct file * file;
@@ -62,7 +80,7 @@ int sys_read(unsigned int fd,char * buf,int count)
 	if (S_ISCHR(inode->i_mode))
 		return rw_char(READ,inode->i_zone[0],buf,count);
 	if (S_ISBLK(inode->i_mode))
-		return block_read(inode->i_zone[0],&file->f_pos,buf,count);
+		return block_read(inode->i_zone[0],file,buf,count);
 	if (S_ISDIR(inode->i_mode) || S_ISREG(inode->i_mode)) {
 		if (count+file->f_pos > inode->i_size)
 			count = inode->i_size - file->f_pos;
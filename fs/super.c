@@ -37,17 +37,28 @@ struct super_block * do_mount(int dev)
 		p->s_imap[i] = NULL;
 	for (i=0;i<Z_MAP_SLOTS;i++)
 		p->s_zmap[i] = NULL;
+	if (p->s_imap_blocks > I_MAP_SLOTS || p->s_zmap_blocks > Z_MAP_SLOTS) {
+		p->s_dev = 0;
+		return NULL;
+	}
+/* queue all the bitmap blocks at once, then wait for them */
 	block=2;
 	for (i=0 ; i < p->s_imap_blocks ; i++)
-		if (p->s_imap[i]=bread(dev,block))
-			block++;
-		else
-			break;
+		p->s_imap[i] = getblk(dev,block++);
 	for (i=0 ; i < p->s_zmap_blocks ; i++)
-		if (p->s_zmap[i]=bread(dev,block))
-			block++;
-		else
-			break;
+		p->s_zmap[i] = getblk(dev,block++);
+	ll_rw_blocks(READ,p->s_imap_blocks,p->s_imap);
+	ll_rw_blocks(READ,p->s_zmap_blocks,p->s_zmap);
+	for (i=0 ; i < p->s_imap_blocks ; i++) {
+		wait_on_buffer(p->s_imap[i]);
+		if (!p->s_imap[i]->b_uptodate)
+			block = 0;
+	}
+	for (i=0 ; i < p->s_zmap_blocks ; i++) {
+		wait_on_buffer(p->s_zmap[i]);
+		if (!p->s_zmap[i]->b_uptodate)
+			block = 0;
+	}
 	if (block != 2+p->s_imap_blocks+p->s_zmap_blocks) {
 		for(i=0;i<I_MAP_SLOTS;i++)
 			brelse(p->s_imap[i]);
@@ -1,8 +1,6 @@
 #ifndef _CONST_H
 #define _CONST_H
 
-#define BUFFER_END 0x200000
-
 #define I_TYPE          0170000
 #define I_DIRECTORY	0040000
 #define I_REGULAR       0100000
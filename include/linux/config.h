@@ -5,24 +5,21 @@
 #define LINUS_HD
 
 /*
- * Amount of ram memory (in bytes, 640k-1M not discounted). Currently 8Mb.
- * Don't make this bigger without making sure that there are enough page
- * directory entries (boot/head.s)
+ * Writeback: the bdflush daemon wakes up every BDFLUSH_INTERVAL ticks and
+ * writes out buffers that have been dirty for BDFLUSH_AGE ticks. Writers
+ * are made to wait for it when more than BDFLUSH_RATIO percent of the
+ * buffers are dirty. The age and ratio can be changed with bdflush().
  */
-#if	defined(LINUS_HD)
-#define HIGH_MEMORY (0x800000)
-#elif	defined(LASU_HD)
-#define HIGH_MEMORY (0x400000)
-#else
-#error "must define hd"
-#endif
+#define BDFLUSH_INTERVAL (5*HZ)
+#define BDFLUSH_AGE (30*HZ)
+#define BDFLUSH_RATIO 40
 
-/* End of buffer memory. Must be 0xA0000, or > 0x100000, 4096-byte aligned */
-#if (HIGH_MEMORY>=0x600000)
-#define BUFFER_END 0x200000
-#else
-#define BUFFER_END 0xA0000
-#endif
+/*
+ * The swap partition, or 0 for no swapping. The first page of it is a
+ * bitmap of the pages that may be used, ending in "SWAP-SPACE". For
+ * /dev/hd4 (say), use 0x304.
+ */
+#define SWAP_DEV 0
 
 /* Root device at bootup. */
 #if	defined(LINUS_HD)
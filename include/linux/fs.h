@@ -25,8 +25,9 @@
 
 #define READ 0
 #define WRITE 1
+#define READA 2		/* read-ahead - don't wait for it, or for requests */
 
-void buffer_init(void);
+void buffer_init(long buffer_end, long memory_end);
 
 #define MAJOR(a) (((unsigned)(a))>>8)
 #define MINOR(a) ((a)&0xff)
@@ -41,7 +42,9 @@ void buffer_init(void);
 #define NR_INODE 32
 #define NR_FILE 64
 #define NR_SUPER 8
-#define NR_HASH 307
+#define MIN_HASH 64	/* the buffer hash is sized by buffer_init() */
+#define READA_MIN 2	/* read-ahead window in blocks, first ... */
+#define READA_MAX 16	/* ... and largest */
 #define NR_BUFFERS nr_buffers
 #define BLOCK_SIZE 1024
 #ifndef NULL
@@ -61,11 +64,18 @@ struct buffer_head {
 	unsigned char b_dirt;		/* 0-clean,1-dirty */
 	unsigned char b_count;		/* users using this block */
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */
-	struct task_struct * b_wait;
+	struct wait_queue * b_wait;
 	struct buffer_head * b_prev;
 	struct buffer_head * b_next;
 	struct buffer_head * b_prev_free;
 	struct buffer_head * b_next_free;
+	struct buffer_head * b_reqnext;	/* next buffer in the same request */
+	unsigned char b_lru;		/* 0 - probation, 1 - protected list */
+	struct buffer_head * b_prev_dirty;	/* per-device dirty list, */
+	struct buffer_head * b_next_dirty;	/* sorted by block number */
+	long b_dirtied;			/* jiffies when it was made dirty */
+	struct buffer_head * b_this_page;	/* ring of buffers in a page */
+	unsigned char b_nocache;	/* not in the cache (swap I/O) */
 };
 
 struct d_inode {
@@ -87,7 +97,7 @@ struct m_inode {
 	unsigned char i_nlinks;
 	unsigned short i_zone[9];
 /* these are in memory also */
-	struct task_struct * i_wait;
+	struct wait_queue * i_wait;
 	unsigned long i_atime;
 	unsigned long i_ctime;
 	unsigned short i_dev;
@@ -115,6 +125,9 @@ struct file {
 	unsigned short f_count;
 	struct m_inode * f_inode;
 	off_t f_pos;
+	off_t f_rapos;			/* where the last read ended */
+	int f_raend;			/* first block not yet read ahead */
+	unsigned short f_reada;		/* read-ahead window, in blocks */
 };
 
 struct super_block {
@@ -162,9 +175,17 @@ extern struct m_inode * get_empty_inode(void);
 extern struct m_inode * get_pipe_inode(void);
 extern struct buffer_head * get_hash_table(int dev, int block);
 extern struct buffer_head * getblk(int dev, int block);
-extern void ll_rw_block(int rw, struct buffer_head * bh);
+extern int ll_rw_block(int rw, struct buffer_head * bh);
+extern int ll_rw_blocks(int rw, int nr, struct buffer_head * bh[]);
+extern void wait_on_buffer(struct buffer_head * bh);
+extern void mark_buffer_dirty(struct buffer_head * bh);
+extern void mark_buffer_clean(struct buffer_head * bh);
+extern void balance_dirty(void);
 extern void brelse(struct buffer_head * buf);
 extern struct buffer_head * bread(int dev,int block);
+extern void breada(int dev,int block);
+extern int bread_page(unsigned long address,int dev,int b[4]);
+extern int reada_window(struct file * filp, int count);
 extern int new_block(int dev);
 extern void free_block(int dev, int block);
 extern struct m_inode * new_inode(int dev);
@@ -4,7 +4,32 @@
 #define PAGE_SIZE 4096
 
 extern unsigned long get_free_page(void);
+extern unsigned long get_uncleared_page(void);
+extern int zero_free_page(void);
+extern void * kmalloc(unsigned int size);
+extern void kfree(void * obj);
 extern unsigned long put_page(unsigned long page,unsigned long address);
 extern void free_page(unsigned long addr);
+extern int shrink_buffers(int pages);
+extern void mem_init(long start_mem, long end_mem);
+
+extern void swap_init(void);
+extern int get_swap_page(void);
+extern void swap_free(int nr);
+extern void swap_duplicate(int nr);
+extern int read_swap_page(int nr, unsigned long page);
+extern int write_swap_page(int nr, unsigned long page);
+
+extern int nr_free_pages;
+
+/*
+ * The buffer cache takes pages for itself while more than FREE_PAGES_HIGH
+ * are free, and gives them back when fewer than FREE_PAGES_LOW are left.
+ */
+#define FREE_PAGES_HIGH 128
+#define FREE_PAGES_LOW 32
+
+/* Below FREE_PAGES_MIN free pages, the fault handlers start swapping. */
+#define FREE_PAGES_MIN 16
 
 #endif
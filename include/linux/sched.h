@@ -1,7 +1,7 @@
 #ifndef _SCHED_H
 #define _SCHED_H
 
-#define NR_TASKS 64
+#define NR_TASKS 128
 #define HZ 100
 
 #define FIRST_TASK task[0]
@@ -10,6 +10,7 @@
 #include <linux/head.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/timer.h>
 
 #if (NR_OPEN > 32)
 #error "Currently the close-on-exec-flags are in one word, max 32 files/proc"
@@ -25,9 +26,6 @@
 #define NULL ((void *) 0)
 #endif
 
-extern int copy_page_tables(unsigned long from, unsigned long to, long size);
-extern int free_page_tables(unsigned long from, long size);
-
 extern void sched_init(void);
 extern void schedule(void);
 extern void trap_init(void);
@@ -96,14 +94,46 @@ struct task_struct {
 	unsigned short umask;
 	struct m_inode * pwd;
 	struct m_inode * root;
+	struct m_inode * executable;	/* demand-loaded from, or NULL */
 	unsigned long close_on_exec;
 	struct file * filp[NR_OPEN];
 /* ldt for this task 0 - zero 1 - cs 2 - ds&ss */
 	struct desc_struct ldt[3];
 /* tss for this task */
 	struct tss_struct tss;
+/* run queue links, see sched.c */
+	int nr;			/* slot in task[] */
+	int run_nr;		/* which run queue we're on */
+	unsigned long epoch;	/* counter last refreshed in this epoch */
+	struct task_struct * next_run, * prev_run;
+	struct timer_list alarm_timer;	/* sends SIGALRM at 'alarm' */
+	struct timer_list timeout;	/* tty_read()'s VTIME */
+	long policy, rt_priority;	/* SCHED_OTHER/FIFO/RR, 1-31 if not OTHER */
 };
 
+/*
+ * Every task but task 0 has a page directory of its own (tss.cr3, loaded
+ * by the task switch), which maps the kernel's 16Mb at the bottom just
+ * like pg_dir does. Tasks all live at TASK_BASE in theirs, so the number
+ * of tasks and the size of each no longer have to share the 4Gb.
+ */
+#define TASK_BASE 0x40000000
+#define TASK_SIZE 0x40000000
+
+/* the page directory entry for linear address 'addr' in task p */
+#define dir_entry(p,addr) \
+((unsigned long *) ((p)->tss.cr3 + (((addr)>>20) & 0xffc)))
+
+extern int copy_page_tables(struct task_struct * p,
+	unsigned long from, unsigned long to, long size);
+extern int free_page_tables(struct task_struct * p,
+	unsigned long from, unsigned long size);
+extern unsigned long put_task_page(struct task_struct * p,
+	unsigned long page, unsigned long address);
+extern struct task_struct * copy_task(int nr);
+extern int find_empty_process(void);
+extern void free_last_dead(void);
+
 /*
  *  INIT_TASK is used to set up the first task table, touch at
  * your own risk!. Base=0, limit=0x9ffff (=640kB)
@@ -116,7 +146,7 @@ struct task_struct {
 /* uid etc */	0,0,0,0,0,0, \
 /* alarm */	0,0,0,0,0,0, \
 /* math */	0, \
-/* fs info */	-1,0133,NULL,NULL,0, \
+/* fs info */	-1,0133,NULL,NULL,NULL,0, \
 /* filp */	{NULL,}, \
 	{ \
 		{0,0}, \
@@ -135,13 +165,25 @@ extern struct task_struct *task[NR_TASKS];
 extern struct task_struct *last_task_used_math;
 extern struct task_struct *current;
 extern long volatile jiffies;
+extern int need_resched;
 extern long startup_time;
 
 #define CURRENT_TIME (startup_time+jiffies/HZ)
 
-extern void sleep_on(struct task_struct ** p);
-extern void interruptible_sleep_on(struct task_struct ** p);
-extern void wake_up(struct task_struct ** p);
+struct wait_queue {
+	struct task_struct * task;
+	struct wait_queue * next;
+	int exclusive;
+};
+
+extern void sleep_on(struct wait_queue ** p);
+extern void sleep_on_exclusive(struct wait_queue ** p);
+extern void interruptible_sleep_on(struct wait_queue ** p);
+extern void wake_up(struct wait_queue ** p);
+extern void wake_up_all(struct wait_queue ** p);
+extern int wake_up_process(struct task_struct * p);
+extern void set_alarm(long expires);
+extern unsigned long timer_ticks(void);
 
 /*
  * Entry into gdt where to find first TSS. 0-nul, 1-cs, 2-ds, 3-syscall
@@ -0,0 +1,28 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+/*
+ * Kernel timers. 'fn(data)' is called from the timer interrupt the first
+ * tick jiffies reaches 'expires'. A timer is on a list (next != NULL)
+ * from add_timer() until it has run or is deleted, and it can be
+ * re-added after that. The caller owns the struct and must del_timer()
+ * it before it goes away.
+ */
+struct timer_list {
+	struct timer_list * next, * prev;
+	long expires;
+	unsigned long data;
+	void (*fn)(unsigned long);
+};
+
+#define init_timer(t) ((t)->next = (t)->prev = NULL)
+#define timer_pending(t) ((t)->next != NULL)
+
+extern void timer_init(void);
+extern void add_timer(struct timer_list * timer);
+extern int del_timer(struct timer_list * timer);
+extern void mod_timer(struct timer_list * timer, long expires);
+extern void run_timers(void);
+extern int timer_idle_ticks(int max);
+
+#endif
@@ -29,6 +29,11 @@
 #define SEEK_CUR	1
 #define SEEK_END	2
 
+/* sched_setscheduler */
+#define SCHED_OTHER	0
+#define SCHED_FIFO	1
+#define SCHED_RR	2
+
 /* _SC stands for System Configuration. We don't use them much */
 #define _SC_ARG_MAX		1
 #define _SC_CHILD_MAX		2
@@ -124,6 +129,9 @@
 #define __NR_getppid	64
 #define __NR_getpgrp	65
 #define __NR_setsid	66
+#define __NR_bdflush	67
+#define __NR_spawn	68
+#define __NR_sched_setscheduler	69
 
 #define _syscall0(type,name) \
 type name(void) \
@@ -176,6 +184,18 @@ if (__res<0) \
 return __res;\
 }
 
+#define _syscall4(type,name,atype,a,btype,b,ctype,c,dtype,d) \
+type name(atype a,btype b,ctype c,dtype d) \
+{ \
+type __res; \
+__asm__ volatile ("int $0x80" \
+	: "=a" (__res) \
+	: "0" (__NR_##name),"b" (a),"c" (b),"d" (c),"S" (d)); \
+if (__res<0) \
+	errno=-__res , __res = -1; \
+return __res;\
+}
+
 #endif /* __LIBRARY__ */
 
 extern int errno;
@@ -221,6 +241,8 @@ int read(int fildes, char * buf, off_t count);
 int setpgrp(void);
 int setpgid(pid_t pid,pid_t pgid);
 int setuid(uid_t uid);
+int spawn(const char * filename, char ** argv, char ** envp, long fdmask);
+int sched_setscheduler(pid_t pid, int policy, int prio);
 int setgid(gid_t gid);
 void (*signal(int sig, void (*fn)(int)))(int);
 int stat(const char * filename, struct stat * stat_buf);
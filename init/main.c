@@ -18,6 +18,9 @@ static inline _syscall0(int,fork)
 static inline _syscall0(int,pause)
 static inline _syscall0(int,setup)
 static inline _syscall0(int,sync)
+static inline _syscall2(int,bdflush,int,func,long,data)
+static inline _syscall4(int,spawn,const char *,file,char **,argv,
+	char **,envp,long,fdmask)
 
 #include <linux/tty.h>
 #include <linux/sched.h>
@@ -32,6 +35,7 @@ static inline _syscall0(int,sync)
 #include <sys/types.h>
 
 #include <linux/fs.h>
+#include <linux/mm.h>
 
 static char printbuf[1024];
 
@@ -55,6 +59,16 @@ inb_p(0x71); \
 
 #define BCD_TO_BIN(val) ((val)=((val)&15) + ((val)>>4)*10)
 
+/*
+ * boot.s leaves the amount of memory above 1Mb (in kB) here. We use
+ * at most 16Mb, as that is all head.s maps.
+ */
+#define EXT_MEM_K (*(unsigned short *)0x901FC)
+
+static long memory_end = 0;
+static long buffer_memory_end = 0;
+static long main_memory_start = 0;
+
 static void time_init(void)
 {
 	struct tm time;
@@ -82,11 +96,25 @@ void main(void)		/* This really IS void, no error here. */
  * Interrupts are still disabled. Do necessary setups, then
  * enable them
  */
+	memory_end = (1<<20) + (EXT_MEM_K<<10);
+	memory_end &= 0xfffff000;
+	if (memory_end > 16*1024*1024)
+		memory_end = 16*1024*1024;
+	if (memory_end > 12*1024*1024)
+		buffer_memory_end = 4*1024*1024;
+	else if (memory_end >= 6*1024*1024)
+		buffer_memory_end = 2*1024*1024;
+	else
+		buffer_memory_end = 0xA0000;
+	main_memory_start = buffer_memory_end;
+	if (main_memory_start < 0x100000)
+		main_memory_start = 0x100000;
 	time_init();
 	tty_init();
 	trap_init();
 	sched_init();
-	buffer_init();
+	mem_init(main_memory_start,memory_end);
+	buffer_init(buffer_memory_end,memory_end);
 	hd_init();
 	sti();
 	move_to_user_mode();
@@ -123,7 +151,8 @@ void init(void)
 
 	setup();
 	if (!fork())
-		_exit(execve("/bin/update",NULL,NULL));
+		_exit(bdflush(0,0));
+	(void) spawn("/bin/update",NULL,NULL,0);
 	(void) open("/dev/tty0",O_RDWR,0);
 	(void) dup(0);
 	(void) dup(0);
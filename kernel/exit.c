@@ -6,10 +6,37 @@
 #include <linux/kernel.h>
 #include <linux/tty.h>
 #include <asm/segment.h>
+#include <asm/system.h>
 
 int sys_pause(void);
 int sys_close(int fd);
 
+/*
+ * A task without a father releases itself in do_exit(), but it can't
+ * free the page directory and task_struct it is still running on. They
+ * are left in last_dead, to be freed by whoever runs next (see
+ * schedule()) or by the next release().
+ */
+static struct task_struct * last_dead = NULL;
+
+void free_last_dead(void)
+{
+	struct task_struct * p;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if ((p = last_dead) && p != current)
+		last_dead = NULL;
+	else
+		p = NULL;
+	restore_flags(flags);
+	if (p) {
+		free_page(p->tss.cr3);
+		free_page((long) p);
+	}
+}
+
 void release(struct task_struct * p)
 {
 	int i;
@@ -19,7 +46,14 @@ void release(struct task_struct * p)
 	for (i=1 ; i<NR_TASKS ; i++)
 		if (task[i]==p) {
 			task[i]=NULL;
-			free_page((long)p);
+			free_last_dead();
+			if (p == current) {
+				p->state = TASK_ZOMBIE;
+				last_dead = p;
+			} else {
+				free_page(p->tss.cr3);
+				free_page((long)p);
+			}
 			schedule();
 			return;
 		}
@@ -34,8 +68,11 @@ static inline void send_sig(long sig,struct task_struct * p,int priv)
 		current->uid==p->uid ||
 		current->euid==p->uid ||
 		current->uid==p->euid ||
-		current->euid==p->euid)
+		current->euid==p->euid) {
 		p->signal |= (1<<(sig-1));
+		if (p->state == TASK_INTERRUPTIBLE)
+			wake_up_process(p);
+	}
 }
 
 void do_kill(long pid,long sig,int priv)
@@ -65,8 +102,8 @@ int do_exit(long code)
 {
 	int i;
 
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	free_page_tables(current,get_base(current->ldt[1]),get_limit(0x0f));
+	free_page_tables(current,get_base(current->ldt[2]),get_limit(0x17));
 	for (i=0 ; i<NR_TASKS ; i++)
 		if (task[i] && task[i]->father == current->pid)
 			task[i]->father = 0;
@@ -77,10 +114,14 @@ int do_exit(long code)
 	current->pwd=NULL;
 	iput(current->root);
 	current->root=NULL;
+	iput(current->executable);
+	current->executable=NULL;
 	if (current->leader && current->tty >= 0)
 		tty_table[current->tty].pgrp = 0;
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
+	set_alarm(0);
+	del_timer(&current->timeout);
 	if (current->father) {
 		current->state = TASK_ZOMBIE;
 		do_kill(current->father,SIGCHLD,1);
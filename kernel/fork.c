@@ -15,6 +15,9 @@ extern void write_verify(unsigned long address);
 
 long last_pid=0;
 
+/* fork latency, in timer_ticks() (see spawn_stats() in fs/exec.c) */
+unsigned long nr_forks = 0, fork_time = 0;
+
 void verify_area(void * addr,int size)
 {
 	unsigned long start;
@@ -30,6 +33,9 @@ void verify_area(void * addr,int size)
 	}
 }
 
+/*
+ * copy_mem() puts the child's memory at TASK_BASE in its page directory.
+ */
 int copy_mem(int nr,struct task_struct * p)
 {
 	unsigned long old_data_base,new_data_base,data_limit;
@@ -43,40 +49,49 @@ int copy_mem(int nr,struct task_struct * p)
 		panic("We don't support separate I&D");
 	if (data_limit < code_limit)
 		panic("Bad data_limit");
-	new_data_base = new_code_base = nr * 0x4000000;
+	new_data_base = new_code_base = TASK_BASE;
 	set_base(p->ldt[1],new_code_base);
 	set_base(p->ldt[2],new_data_base);
-	if (copy_page_tables(old_data_base,new_data_base,data_limit)) {
-		free_page_tables(new_data_base,data_limit);
+	if (copy_page_tables(p,old_data_base,new_data_base,data_limit)) {
+		free_page_tables(p,new_data_base,data_limit);
 		return -ENOMEM;
 	}
 	return 0;
 }
 
 /*
- *  Ok, this is the main fork-routine. It copies the system process
- * information (task[nr]) and sets up the necessary registers. It
- * also copies the data segment in it's entirety.
+ * copy_task() is the part of fork that spawn needs too: a new task
+ * struct for slot nr, copied from the current one but with its own pid,
+ * times etc, and a page directory of its own holding just the kernel
+ * mappings from pg_dir. The caller fills in the rest, and puts it in
+ * task[] when done.
  */
-int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
-		long ebx,long ecx,long edx,
-		long fs,long es,long ds,
-		long eip,long cs,long eflags,long esp,long ss)
+struct task_struct * copy_task(int nr)
 {
 	struct task_struct *p;
 	int i;
-	struct file *f;
 
-	p = (struct task_struct *) get_free_page();
+	p = (struct task_struct *) get_uncleared_page();
 	if (!p)
-		return -EAGAIN;
+		return NULL;
 	*p = *current;	/* NOTE! this doesn't copy the supervisor stack */
-	p->state = TASK_RUNNING;
+	if (!(p->tss.cr3 = get_free_page())) {
+		free_page((long) p);
+		return NULL;
+	}
+	for (i=0 ; i < (TASK_BASE>>22) ; i++)
+		((unsigned long *) p->tss.cr3)[i] = pg_dir[i];
+	p->state = TASK_UNINTERRUPTIBLE;	/* until it's in task[] */
+	p->nr = nr;
+	p->epoch = current->epoch;
+	p->next_run = p->prev_run = NULL;
 	p->pid = last_pid;
 	p->father = current->pid;
 	p->counter = p->priority;
 	p->signal = 0;
 	p->alarm = 0;
+	init_timer(&p->alarm_timer);
+	init_timer(&p->timeout);
 	p->leader = 0;		/* process leadership doesn't inherit */
 	p->utime = p->stime = 0;
 	p->cutime = p->cstime = 0;
@@ -84,6 +99,28 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	p->tss.back_link = 0;
 	p->tss.esp0 = PAGE_SIZE + (long) p;
 	p->tss.ss0 = 0x10;
+	p->tss.ldt = _LDT(nr);
+	p->tss.trace_bitmap = 0x80000000;
+	return p;
+}
+
+/*
+ *  Ok, this is the main fork-routine. It copies the system process
+ * information (task[nr]) and sets up the necessary registers. It
+ * also copies the data segment in it's entirety.
+ */
+int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
+		long ebx,long ecx,long edx,
+		long fs,long es,long ds,
+		long eip,long cs,long eflags,long esp,long ss)
+{
+	struct task_struct *p;
+	int i;
+	struct file *f;
+	unsigned long start = timer_ticks();
+
+	if (!(p = copy_task(nr)))
+		return -EAGAIN;
 	p->tss.eip = eip;
 	p->tss.eflags = eflags;
 	p->tss.eax = 0;
@@ -100,11 +137,10 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	p->tss.ds = ds & 0xffff;
 	p->tss.fs = fs & 0xffff;
 	p->tss.gs = gs & 0xffff;
-	p->tss.ldt = _LDT(nr);
-	p->tss.trace_bitmap = 0x80000000;
 	if (last_task_used_math == current)
 		__asm__("fnsave %0"::"m" (p->tss.i387));
 	if (copy_mem(nr,p)) {
+		free_page(p->tss.cr3);
 		free_page((long) p);
 		return -EAGAIN;
 	}
@@ -115,9 +151,14 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 		current->pwd->i_count++;
 	if (current->root)
 		current->root->i_count++;
+	if (current->executable)
+		current->executable->i_count++;
 	set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY,&(p->tss));
 	set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&(p->ldt));
 	task[nr] = p;	/* do this last, just in case */
+	wake_up_process(p);
+	nr_forks++;
+	fork_time += timer_ticks() - start;
 	return last_pid;
 }
 
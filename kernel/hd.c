@@ -2,6 +2,7 @@
 #include <linux/sched.h>
 #include <linux/fs.h>
 #include <linux/kernel.h>
+#include <linux/mm.h>
 #include <linux/hdreg.h>
 #include <asm/system.h>
 #include <asm/io.h>
@@ -20,6 +21,8 @@
 #define MAX_ERRORS	5
 #define MAX_HD		2
 #define NR_REQUEST	32
+/* Max sectors/request when merging. Must be even, and less than 256 */
+#define MAX_SECTORS	16
 
 /*
  *  This struct defines the HD's and their types.
@@ -37,23 +40,27 @@ static struct hd_struct {
 	long nr_sects;
 } hd[5*MAX_HD]={{0,0},};
 
+/*
+ * A request covers nsector consecutive sectors starting at the absolute
+ * sector 'block'. Each buffer is two sectors, and the buffers of a merged
+ * request are chained through b_reqnext, 'bh' being the one currently
+ * transferred. 'block' and 'bh' move on as buffers are done, so that a
+ * retry after an error starts at the right place.
+ */
 static struct hd_request {
 	int hd;		/* -1 if no request */
 	int nsector;
-	int sector;
-	int head;
-	int cyl;
+	unsigned int block;
 	int cmd;
 	int errors;
 	struct buffer_head * bh;
+	struct buffer_head * bhtail;
 	struct hd_request * next;
 } request[NR_REQUEST];
 
 #define IN_ORDER(s1,s2) \
 ((s1)->hd<(s2)->hd || (s1)->hd==(s2)->hd && \
-((s1)->cyl<(s2)->cyl || (s1)->cyl==(s2)->cyl && \
-((s1)->head<(s2)->head || (s1)->head==(s2)->head && \
-((s1)->sector<(s2)->sector))))
+(s1)->block<(s2)->block)
 
 static struct hd_request * this_request = NULL;
 
@@ -61,8 +68,8 @@ static int sorting=0;
 
 static void do_request(void);
 static void reset_controller(void);
-static void rw_abs_hd(int rw,unsigned int nr,unsigned int sec,unsigned int head,
-	unsigned int cyl,struct buffer_head * bh);
+static void rw_abs_hd(int rw,unsigned int nr,unsigned int block,
+	struct buffer_head * bh);
 void hd_init(void);
 
 #define port_read(port,buf,nr) \
@@ -73,7 +80,7 @@ __asm__("cld;rep;outsw"::"d" (port),"S" (buf),"c" (nr):"cx","si")
 
 extern void hd_interrupt(void);
 
-static struct task_struct * wait_for_request=NULL;
+static struct wait_queue * wait_for_request=NULL;
 
 static inline void lock_buffer(struct buffer_head * bh)
 {
@@ -90,30 +97,20 @@ static inline void unlock_buffer(struct buffer_head * bh)
 	wake_up(&bh->b_wait);
 }
 
-static inline void wait_on_buffer(struct buffer_head * bh)
-{
-	cli();
-	while (bh->b_lock)
-		sleep_on(&bh->b_wait);
-	sti();
-}
-
-void rw_hd(int rw, struct buffer_head * bh)
+int rw_hd(int rw, struct buffer_head * bh)
 {
 	unsigned int block,dev;
-	unsigned int sec,head,cyl;
 
 	block = bh->b_blocknr << 1;
 	dev = MINOR(bh->b_dev);
-	if (dev >= 5*NR_HD || block+2 > hd[dev].nr_sects)
-		return;
+	if (dev >= 5*NR_HD || block+2 > hd[dev].nr_sects) {
+		printk("hd: block %d past end of device %04x\n\r",
+			bh->b_blocknr,bh->b_dev);
+		return -1;
+	}
 	block += hd[dev].start_sect;
-	dev /= 5;
-	__asm__("divl %4":"=a" (block),"=d" (sec):"0" (block),"1" (0),
-		"r" (hd_info[dev].sect));
-	__asm__("divl %4":"=a" (cyl),"=d" (head):"0" (block),"1" (0),
-		"r" (hd_info[dev].head));
-	rw_abs_hd(rw,dev,sec+1,head,cyl,bh);
+	rw_abs_hd(rw,dev/5,block,bh);
+	return 0;
 }
 
 /* This may be used only once, enforced by 'static int callable' */
@@ -127,7 +124,8 @@ int sys_setup(void)
 		return -1;
 	callable = 0;
 	for (drive=0 ; drive<NR_HD ; drive++) {
-		rw_abs_hd(READ,drive,1,0,0,(struct buffer_head *) start_buffer);
+		rw_abs_hd(READ,drive,0,(struct buffer_head *) start_buffer);
+		wait_on_buffer(start_buffer);
 		if (!start_buffer->b_uptodate) {
 			printk("Unable to read partition table of drive %d\n\r",
 				drive);
@@ -145,6 +143,7 @@ int sys_setup(void)
 		}
 	}
 	printk("Partition table%s ok.\n\r",(NR_HD>1)?"s":"");
+	swap_init();
 	mount_root();
 	return (0);
 }
@@ -236,16 +235,49 @@ void unexpected_hd_interrupt(void)
 	panic("Unexpected HD interrupt\n\r");
 }
 
+/*
+ * end_buffer() finishes the current buffer of this_request, and moves
+ * the request on to the next one (if any). A buffer that couldn't be
+ * written still has good data: it goes back on the dirty list to be
+ * tried again later, instead of being lost. One that isn't in the cache
+ * gets b_uptodate cleared, so the caller can tell.
+ */
+static void end_buffer(int uptodate)
+{
+	struct buffer_head * bh = this_request->bh;
+
+	this_request->bh = bh->b_reqnext;
+	this_request->block += 2;
+	bh->b_reqnext = NULL;
+	if (this_request->cmd != WIN_WRITE)
+		bh->b_uptodate = uptodate;
+	else if (!uptodate) {
+		if (bh->b_nocache)
+			bh->b_uptodate = 0;
+		else
+			mark_buffer_dirty(bh);
+	}
+	unlock_buffer(bh);
+}
+
+static void end_request(void)
+{
+	wake_up(&wait_for_request);
+	this_request->hd = -1;
+	this_request=this_request->next;
+}
+
 static void bad_rw_intr(void)
 {
 	int i = this_request->hd;
 
+/* a half-done buffer is always redone from its first sector */
+	this_request->nsector = (this_request->nsector+1) & ~1;
 	if (this_request->errors++ >= MAX_ERRORS) {
-		this_request->bh->b_uptodate = 0;
-		unlock_buffer(this_request->bh);
-		wake_up(&wait_for_request);
-		this_request->hd = -1;
-		this_request=this_request->next;
+		this_request->errors = 0;
+		end_buffer(0);
+		if (!(this_request->nsector -= 2))
+			end_request();
 	}
 	reset_hd(i);
 }
@@ -259,14 +291,12 @@ static void read_intr(void)
 	port_read(HD_DATA,this_request->bh->b_data+
 		512*(this_request->nsector&1),256);
 	this_request->errors = 0;
-	if (--this_request->nsector)
+	if (--this_request->nsector & 1)
 		return;
-	this_request->bh->b_uptodate = 1;
-	this_request->bh->b_dirt = 0;
-	wake_up(&wait_for_request);
-	unlock_buffer(this_request->bh);
-	this_request->hd = -1;
-	this_request=this_request->next;
+	end_buffer(1);
+	if (this_request->nsector)
+		return;
+	end_request();
 	do_request();
 }
 
@@ -276,32 +306,43 @@ static void write_intr(void)
 		bad_rw_intr();
 		return;
 	}
-	if (--this_request->nsector) {
+	if (--this_request->nsector & 1) {
 		port_write(HD_DATA,this_request->bh->b_data+512,256);
 		return;
 	}
-	this_request->bh->b_uptodate = 1;
-	this_request->bh->b_dirt = 0;
-	wake_up(&wait_for_request);
-	unlock_buffer(this_request->bh);
-	this_request->hd = -1;
-	this_request=this_request->next;
+	end_buffer(1);
+	if (this_request->nsector) {
+		port_write(HD_DATA,this_request->bh->b_data,256);
+		return;
+	}
+	end_request();
 	do_request();
 }
 
+/*
+ * NOTE! When called while add_request() is sorting we mustn't start
+ * anything. Nothing is outstanding then, so do_hd is cleared, and that
+ * way the sorter knows it has to restart things itself.
+ */
 static void do_request(void)
 {
 	int i,r;
+	unsigned int block,dev;
+	unsigned int sec,head,cyl;
 
-	if (sorting)
-		return;
-	if (!this_request) {
+	if (sorting || !this_request) {
 		do_hd=NULL;
 		return;
 	}
+	block = this_request->block;
+	dev = this_request->hd;
+	__asm__("divl %4":"=a" (block),"=d" (sec):"0" (block),"1" (0),
+		"r" (hd_info[dev].sect));
+	__asm__("divl %4":"=a" (cyl),"=d" (head):"0" (block),"1" (0),
+		"r" (hd_info[dev].head));
+	sec++;
 	if (this_request->cmd == WIN_WRITE) {
-		hd_out(this_request->hd,this_request->nsector,this_request->
-			sector,this_request->head,this_request->cyl,
+		hd_out(dev,this_request->nsector,sec,head,cyl,
 			this_request->cmd,&write_intr);
 		for(i=0 ; i<3000 && !(r=inb_p(HD_STATUS)&DRQ_STAT) ; i++)
 			/* nothing */ ;
@@ -312,8 +353,7 @@ static void do_request(void)
 		port_write(HD_DATA,this_request->bh->b_data+
 			512*(this_request->nsector&1),256);
 	} else if (this_request->cmd == WIN_READ) {
-		hd_out(this_request->hd,this_request->nsector,this_request->
-			sector,this_request->head,this_request->cyl,
+		hd_out(dev,this_request->nsector,sec,head,cyl,
 			this_request->cmd,&read_intr);
 	} else
 		panic("unknown hd-command");
@@ -328,8 +368,8 @@ static void add_request(struct hd_request * req)
 {
 	struct hd_request * tmp;
 
-	if (req->nsector != 2)
-		panic("nsector!=2 not implemented");
+	if (!req->nsector || (req->nsector & 1))
+		panic("bad nsector in add_request");
 /*
  * Not to mess up the linked lists, we never touch the two first
  * entries (not this_request, as it is used by current interrups,
@@ -365,33 +405,81 @@ static void add_request(struct hd_request * req)
 		do_request();
 }
 
-void rw_abs_hd(int rw,unsigned int nr,unsigned int sec,unsigned int head,
-	unsigned int cyl,struct buffer_head * bh)
+/*
+ * merge_request() tries to add a buffer to the end of an already queued
+ * request for the sectors just before it, so that the drive gets a single
+ * multi-sector command. Like add_request() it doesn't touch the first two
+ * entries: this_request is being transferred, and this_request->next can
+ * become this_request at any time.
+ */
+static int merge_request(unsigned int nr,unsigned int block,int cmd,
+	struct buffer_head * bh)
+{
+	struct hd_request * req = NULL;
+
+	sorting=1;
+	if (this_request && (req=this_request->next))
+		for (req=req->next ; req ; req=req->next)
+			if (req->hd==nr && req->cmd==cmd &&
+			    req->block+req->nsector==block &&
+			    req->nsector+2<=MAX_SECTORS) {
+				req->bhtail->b_reqnext=bh;
+				req->bhtail=bh;
+				req->nsector+=2;
+				break;
+			}
+	sorting=0;
+	if (!do_hd)
+		do_request();
+	return req!=NULL;
+}
+
+/*
+ * rw_abs_hd() only queues the request, it's up to the caller to wait on
+ * the buffer. READA is a read that may be dropped: if the buffer is
+ * already busy, or if it would have to take one of the last quarter of
+ * the requests - there should always be room for the reads somebody is
+ * actually going to wait for.
+ */
+void rw_abs_hd(int rw,unsigned int nr,unsigned int block,
+	struct buffer_head * bh)
 {
-	struct hd_request * req;
+	struct hd_request * req, * last;
+	int cmd,rw_ahead;
 
+	if (rw_ahead = (rw==READA)) {
+		if (bh->b_lock)
+			return;
+		rw = READ;
+	}
 	if (rw!=READ && rw!=WRITE)
 		panic("Bad hd command, must be R/W");
+	cmd = (rw==READ)?WIN_READ:WIN_WRITE;
 	lock_buffer(bh);
+	bh->b_reqnext=NULL;
+	if (merge_request(nr,block,cmd,bh))
+		return;
+	last = request + (rw_ahead ? NR_REQUEST*3/4 : NR_REQUEST);
 repeat:
-	for (req=0+request ; req<NR_REQUEST+request ; req++)
+	for (req=0+request ; req<last ; req++)
 		if (req->hd<0)
 			break;
-	if (req==NR_REQUEST+request) {
-		sleep_on(&wait_for_request);
+	if (req==last) {
+		if (rw_ahead) {
+			unlock_buffer(bh);
+			return;
+		}
+		sleep_on_exclusive(&wait_for_request);
 		goto repeat;
 	}
 	req->hd=nr;
 	req->nsector=2;
-	req->sector=sec;
-	req->head=head;
-	req->cyl=cyl;
-	req->cmd = ((rw==READ)?WIN_READ:WIN_WRITE);
-	req->bh=bh;
+	req->block=block;
+	req->cmd=cmd;
+	req->bh=req->bhtail=bh;
 	req->errors=0;
 	req->next=NULL;
 	add_request(req);
-	wait_on_buffer(bh);
 }
 
 void hd_init(void)
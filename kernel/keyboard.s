@@ -58,7 +58,12 @@ e0_e1:	inb $0x61,%al
 	pushl $0
 	call _do_tty_interrupt
 	addl $4,%esp
-	pop %es
+	cmpl $0,_need_resched	/* preempt, if it woke a real-time task */
+	je 1f			/* and we came from user mode */
+	testl $3,28(%esp)
+	je 1f
+	call _schedule
+1:	pop %es
 	pop %ds
 	popl %edx
 	popl %ecx
@@ -90,10 +95,12 @@ put_queue:
 	shrl $8,%ebx
 	jmp 1b
 2:	movl %ecx,head(%edx)
-	movl proc_list(%edx),%ecx
-	testl %ecx,%ecx
-	je 3f
-	movl $0,(%ecx)
+	pushl %eax
+	leal proc_list(%edx),%ecx	# wake up sleeping processes
+	pushl %ecx
+	call _wake_up
+	addl $4,%esp
+	popl %eax
 3:	popl %edx
 	popl %ecx
 	ret
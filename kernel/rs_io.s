@@ -61,7 +61,12 @@ rep_int:
 	jmp rep_int
 end:	movb $0x20,%al
 	outb %al,$0x20		/* EOI */
-	pop %ds
+	cmpl $0,_need_resched	/* preempt, if it woke a real-time task */
+	je 1f			/* and we came from user mode */
+	testl $3,32(%esp)
+	je 1f
+	call _schedule
+1:	pop %ds
 	pop %es
 	popl %eax
 	popl %ebx
@@ -113,10 +118,14 @@ write_char:
 	je write_buffer_empty
 	cmpl $startup,%ebx
 	ja 1f
-	movl proc_list(%ecx),%ebx	# wake up sleeping process
-	testl %ebx,%ebx			# is there any?
-	je 1f
-	movl $0,(%ebx)
+	pushl %ecx
+	pushl %edx
+	leal proc_list(%ecx),%ebx	# wake up sleeping processes
+	pushl %ebx
+	call _wake_up
+	addl $4,%esp
+	popl %edx
+	popl %ecx
 1:	movl tail(%ecx),%ebx
 	movb buf(%ecx,%ebx),%al
 	outb %al,%dx
@@ -128,11 +137,15 @@ write_char:
 	ret
 .align 2
 write_buffer_empty:
-	movl proc_list(%ecx),%ebx	# wake up sleeping process
-	testl %ebx,%ebx			# is there any?
-	je 1f
-	movl $0,(%ebx)
-1:	incl %edx
+	pushl %ecx
+	pushl %edx
+	leal proc_list(%ecx),%ebx	# wake up sleeping processes
+	pushl %ebx
+	call _wake_up
+	addl $4,%esp
+	popl %edx
+	popl %ecx
+	incl %edx
 	inb %dx,%al
 	jmp 1f
 1:	jmp 1f
@@ -7,6 +7,8 @@
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <signal.h>
+#include <errno.h>
+#include <unistd.h>
 #include <linux/sys.h>
 #include <asm/system.h>
 #include <asm/io.h>
@@ -27,6 +29,7 @@ union task_union {
 static union task_union init_task = {INIT_TASK,};
 
 long volatile jiffies=0;
+int need_resched=0;
 long startup_time=0;
 struct task_struct *current = &(init_task.task), *last_task_used_math = NULL;
 
@@ -56,121 +59,428 @@ void math_state_restore()
 }
 
 /*
- *  'schedule()' is the scheduler function. This is GOOD CODE! There
- * probably won't be any reason to change this, as it should work well
- * in all circumstances (ie gives IO-bound processes good response etc).
- * The one thing you might take a look at is the signal-handler code here.
+ * The run queues. Every runnable task except task 0 sits on exactly one
+ * of them: run_queue[i] holds the tasks whose counter was i (or more,
+ * for the last one) when they were put there, and bit i of run_bitmap
+ * says the queue isn't empty. Picking the task with the biggest counter
+ * is then a bsr instead of a walk over task[].
+ *
+ * When only queue 0 is left, every runnable task has used up its time,
+ * and a new epoch starts: they get counter>>1 + priority just as before.
+ * Sleeping tasks should get the same for every epoch they slept through,
+ * but that's done when they wake up (refresh_counter), so we never have
+ * to look at them here.
+ *
+ * Real-time tasks (SCHED_FIFO and SCHED_RR) have queues of their own,
+ * run_queue[NR_RUNQ+rt_priority] with bits in rt_bitmap, and always go
+ * before the others. Their counter doesn't decide where they go, and a
+ * SCHED_FIFO one isn't even charged for its time.
+ *
+ * The queues are changed from interrupts (wake_up), so everything here
+ * runs with interrupts off.
+ */
+#define NR_RUNQ 32
+
+static struct task_struct * run_queue[2*NR_RUNQ] = {NULL, };
+static unsigned long run_bitmap = 0;
+static unsigned long rt_bitmap = 0;
+static unsigned long epoch = 0;
+
+static void add_to_runqueue(struct task_struct * p)
+{
+	int nr = (p->counter < NR_RUNQ) ? p->counter : NR_RUNQ-1;
+	struct task_struct * q;
+
+	if (nr < 0)
+		nr = 0;
+	if (p->policy != SCHED_OTHER)
+		nr = NR_RUNQ + p->rt_priority;
+	p->run_nr = nr;
+	if (!(q = run_queue[nr])) {
+		run_queue[nr] = p->next_run = p->prev_run = p;
+		if (nr < NR_RUNQ)
+			run_bitmap |= 1 << nr;
+		else
+			rt_bitmap |= 1 << (nr - NR_RUNQ);
+		return;
+	}
+	p->next_run = q;
+	p->prev_run = q->prev_run;
+	q->prev_run->next_run = p;
+	q->prev_run = p;
+}
+
+static void del_from_runqueue(struct task_struct * p)
+{
+	int nr = p->run_nr;
+
+	if (p->next_run == p) {
+		run_queue[nr] = NULL;
+		if (nr < NR_RUNQ)
+			run_bitmap &= ~(1 << nr);
+		else
+			rt_bitmap &= ~(1 << (nr - NR_RUNQ));
+	} else {
+		p->prev_run->next_run = p->next_run;
+		p->next_run->prev_run = p->prev_run;
+		if (run_queue[nr] == p)
+			run_queue[nr] = p->next_run;
+	}
+	p->next_run = p->prev_run = NULL;
+}
+
+/*
+ * Give a task that slept through some epochs the counter it would have
+ * got from the old loop over all tasks. After a few rounds counter>>1
+ * has nothing left from before, so there's no point going further.
+ */
+static void refresh_counter(struct task_struct * p)
+{
+	unsigned long n = epoch - p->epoch;
+
+	if (n > 8)
+		n = 8;
+	while (n--)
+		p->counter = (p->counter >> 1) + p->priority;
+	p->epoch = epoch;
+}
+
+static void new_epoch(void)
+{
+	struct task_struct * p;
+
+	epoch++;
+	while (p = run_queue[0]) {
+		del_from_runqueue(p);
+		p->counter = (p->counter >> 1) + p->priority;
+		p->epoch = epoch;
+		add_to_runqueue(p);
+	}
+}
+
+/*
+ * wake_up_process() makes a sleeping task runnable, and returns 1 if it
+ * was asleep. It may be called from interrupts. A task that is still on
+ * a run queue (it hasn't got to schedule() after setting its state) just
+ * has its state reset.
+ */
+int wake_up_process(struct task_struct * p)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	if (!p || p == task[0])
+		return 0;
+	save_flags(flags);
+	cli();
+	if (p->state == TASK_INTERRUPTIBLE || p->state == TASK_UNINTERRUPTIBLE) {
+		p->state = TASK_RUNNING;
+		if (!p->next_run) {
+			refresh_counter(p);
+			add_to_runqueue(p);
+		}
+		if (p->policy != SCHED_OTHER && (current->policy == SCHED_OTHER ||
+		    p->rt_priority > current->rt_priority))
+			need_resched = 1;
+		ret = 1;
+	}
+	restore_flags(flags);
+	return ret;
+}
+
+/*
+ *  'schedule()' is the scheduler function. It still runs the task with
+ * the biggest counter, which works well in all circumstances (ie gives
+ * IO-bound processes good response etc), but finds it on the run queues
+ * above instead of looking at every task slot.
+ *
+ * A real-time task that is still runnable stays first in its queue
+ * (it was just preempted), unless it's SCHED_RR and its time is up.
  *
  *   NOTE!!  Task 0 is the 'idle' task, which gets called when no other
  * tasks can run. It can not be killed, and it cannot sleep. The 'state'
- * information in task[0] is never used.
+ * information in task[0] is never used, and it's never on a run queue.
  */
 void schedule(void)
 {
-	int i,next,c;
-	struct task_struct ** p;
-
-/* check alarm, wake up any interruptible tasks that have got a signal */
+	struct task_struct * next;
+	unsigned long flags;
+	int i;
 
-	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-		if (*p) {
-			if ((*p)->alarm && (*p)->alarm < jiffies) {
-					(*p)->signal |= (1<<(SIGALRM-1));
-					(*p)->alarm = 0;
-				}
-			if ((*p)->signal && (*p)->state==TASK_INTERRUPTIBLE)
-				(*p)->state=TASK_RUNNING;
+	save_flags(flags);
+	cli();
+	need_resched = 0;
+/* a signal that came before we went to sleep wakes us right away */
+	if (current->state == TASK_INTERRUPTIBLE && current->signal)
+		current->state = TASK_RUNNING;
+	if (current != task[0]) {
+		if (current->next_run)
+			del_from_runqueue(current);
+		if (current->state == TASK_RUNNING) {
+			add_to_runqueue(current);
+			if (current->policy == SCHED_RR && current->counter <= 0)
+				current->counter = current->priority;
+			else if (current->policy != SCHED_OTHER)
+				run_queue[current->run_nr] = current;
 		}
+	}
+	if (rt_bitmap) {
+		__asm__("bsrl %1,%0":"=r" (i):"r" (rt_bitmap));
+		next = run_queue[NR_RUNQ + i];
+	} else {
+		if (run_bitmap == 1)
+			new_epoch();
+		if (run_bitmap) {
+			__asm__("bsrl %1,%0":"=r" (i):"r" (run_bitmap));
+			next = run_queue[i];
+		} else
+			next = task[0];
+	}
+	switch_to(next->nr);
+	free_last_dead();
+	restore_flags(flags);
+}
 
-/* this is the scheduler proper: */
-
-	while (1) {
-		c = -1;
-		next = 0;
-		i = NR_TASKS;
-		p = &task[NR_TASKS];
-		while (--i) {
-			if (!*--p)
-				continue;
-			if ((*p)->state == TASK_RUNNING && (*p)->counter > c)
-				c = (*p)->counter, next = i;
+/*
+ * Tickless idle. When there's nothing to run and no page to clear, the
+ * idle task sets the 8253 to interrupt just once, at the first tick that
+ * has a timer due (there is no time-slice to end, as nothing else is
+ * runnable), and halts. The 8253 counts at most 65535, so that's no more
+ * than 5 ticks at HZ=100, but it's still an interrupt every 50ms instead
+ * of every 10ms.
+ *
+ * The one-shot always ends on a tick boundary, so jiffies are kept in
+ * step: do_timer() adds the ticks that were left out, and if some other
+ * interrupt wakes us first, cpu_idle() counts the ticks that have gone
+ * by and sets a one-shot for the rest of the current one. Either way
+ * the ticks go to task 0's stime, as they would have with the clock
+ * running.
+ */
+static long idle_ticks = 0;	/* one-shot set for this many, 0 = periodic */
+
+static void set_pit(int mode, unsigned long count)
+{
+	outb_p(mode,0x43);		/* binary, LSB/MSB, ch 0 */
+	outb_p(count & 0xff,0x40);
+	outb(count >> 8,0x40);
+}
+
+static void cpu_idle(void)
+{
+	unsigned long count,left,status;
+	long ticks;
+
+	cli();
+	if (run_bitmap || rt_bitmap) {
+		sti();
+		return;
+	}
+	ticks = timer_idle_ticks(1 + (0xffff - LATCH) / LATCH);
+	if (ticks > 1) {
+		outb_p(0x00,0x43);		/* latch counter 0 */
+		count = inb_p(0x40);
+		count |= inb_p(0x40) << 8;	/* left of this tick */
+		outb_p(0x0a,0x20);		/* 8259 IRR: tick pending? */
+/* don't start if a tick is pending, or may come while we set the 8253 */
+		if (count > LATCH/16 && !(inb_p(0x20) & 1)) {
+			set_pit(0x30,count + (ticks-1)*LATCH);	/* mode 0: one-shot */
+			idle_ticks = ticks;
+		}
+	}
+	__asm__("sti ; hlt"::);
+	cli();
+	if (idle_ticks) {
+		outb_p(0xc2,0x43);		/* read-back: status and count, ch 0 */
+		status = inb_p(0x40);
+		count = inb_p(0x40);
+		count |= inb_p(0x40) << 8;
+		if (!(status & 0x80)) {		/* OUT still low: not run out */
+			left = (count + LATCH - 1) / LATCH;	/* boundaries still to come */
+			jiffies += idle_ticks - left;
+			current->stime += idle_ticks - left;
+			count -= (left - 1) * LATCH;
+			set_pit(0x30,count ? count : 1);
+			idle_ticks = 1;
 		}
-		if (c) break;
-		for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-			if (*p)
-				(*p)->counter = ((*p)->counter >> 1) +
-						(*p)->priority;
 	}
-	switch_to(next);
+	sti();
+}
+
+/* called from do_timer() when the one-shot has run out */
+static void end_idle(void)
+{
+	jiffies += idle_ticks - 1;		/* the timer interrupt did one */
+	current->stime += idle_ticks - 1;
+	idle_ticks = 0;
+	set_pit(0x34,LATCH);			/* mode 2: rate generator */
 }
 
 int sys_pause(void)
 {
+	int busy;
+
+	if (current == task[0]) {
+		busy = zero_free_page();	/* idle: clear a free page */
+		schedule();
+		if (!busy)
+			cpu_idle();
+		return 0;
+	}
 	current->state = TASK_INTERRUPTIBLE;
 	schedule();
 	return 0;
 }
 
-void sleep_on(struct task_struct **p)
+/*
+ * Wait queues: a sleeper puts a wait_queue entry on its own stack on the
+ * list, and takes it off again when it wakes up. Exclusive sleepers go
+ * at the end, and wake_up() wakes everybody up to and including the
+ * first exclusive one it actually gets out of bed, so that waiters for
+ * a resource (a free buffer, a request slot...) can be woken one per
+ * resource instead of all fighting for it. wake_up_all() wakes them all.
+ */
+static void add_wait_queue(struct wait_queue ** p, struct wait_queue * wait)
+{
+	struct wait_queue ** q = p;
+
+	if (wait->exclusive)
+		while (*q)
+			q = &(*q)->next;
+	wait->next = *q;
+	*q = wait;
+}
+
+static void remove_wait_queue(struct wait_queue ** p, struct wait_queue * wait)
+{
+	while (*p && *p != wait)
+		p = &(*p)->next;
+	if (!*p)
+		panic("remove_wait_queue: not on the queue");
+	*p = wait->next;
+}
+
+static void __sleep_on(struct wait_queue ** p, int state, int exclusive)
 {
-	struct task_struct *tmp;
+	struct wait_queue wait;
+	unsigned long flags;
 
 	if (!p)
 		return;
 	if (current == &(init_task.task))
 		panic("task[0] trying to sleep");
-	tmp = *p;
-	*p = current;
-	current->state = TASK_UNINTERRUPTIBLE;
+	wait.task = current;
+	wait.exclusive = exclusive;
+	save_flags(flags);
+	cli();
+	add_wait_queue(p,&wait);
+	current->state = state;
 	schedule();
-	if (tmp)
-		tmp->state=0;
+	remove_wait_queue(p,&wait);
+	restore_flags(flags);
 }
 
-void interruptible_sleep_on(struct task_struct **p)
+void sleep_on(struct wait_queue ** p)
 {
-	struct task_struct *tmp;
+	__sleep_on(p,TASK_UNINTERRUPTIBLE,0);
+}
+
+void sleep_on_exclusive(struct wait_queue ** p)
+{
+	__sleep_on(p,TASK_UNINTERRUPTIBLE,1);
+}
+
+void interruptible_sleep_on(struct wait_queue ** p)
+{
+	__sleep_on(p,TASK_INTERRUPTIBLE,0);
+}
+
+static void __wake_up(struct wait_queue ** p, int all)
+{
+	struct wait_queue * wait;
+	unsigned long flags;
 
 	if (!p)
 		return;
-	if (current == &(init_task.task))
-		panic("task[0] trying to sleep");
-	tmp=*p;
-	*p=current;
-repeat:	current->state = TASK_INTERRUPTIBLE;
-	schedule();
-	if (*p && *p != current) {
-		(**p).state=0;
-		goto repeat;
-	}
-	*p=NULL;
-	if (tmp)
-		tmp->state=0;
+	save_flags(flags);
+	cli();
+	for (wait = *p ; wait ; wait = wait->next)
+		if (wake_up_process(wait->task) && wait->exclusive && !all)
+			break;
+	restore_flags(flags);
 }
 
-void wake_up(struct task_struct **p)
+void wake_up(struct wait_queue ** p)
 {
-	if (p && *p) {
-		(**p).state=0;
-		*p=NULL;
-	}
+	__wake_up(p,0);
+}
+
+void wake_up_all(struct wait_queue ** p)
+{
+	__wake_up(p,1);
 }
 
 void do_timer(long cpl)
 {
+	if (idle_ticks)
+		end_idle();
+	run_timers();
 	if (cpl)
 		current->utime++;
 	else
 		current->stime++;
-	if ((--current->counter)>0) return;
-	current->counter=0;
-	if (!cpl) return;
-	schedule();
+	if (current->policy != SCHED_FIFO && (--current->counter) <= 0) {
+		current->counter = 0;
+		need_resched = 1;
+	}
+	if (need_resched && cpl)
+		schedule();
+}
+
+/*
+ * timer_ticks() is a fine-grained clock for measurements: the time since
+ * boot in units of the 8253 input clock (1.193MHz), modulo 2^32. Only
+ * differences make sense.
+ */
+unsigned long timer_ticks(void)
+{
+	unsigned long j,count,flags;
+
+	save_flags(flags);
+	cli();
+	outb_p(0x00,0x43);		/* latch counter 0 */
+	count = inb_p(0x40);
+	count |= inb_p(0x40) << 8;
+	j = jiffies;
+	restore_flags(flags);
+	return j*LATCH + LATCH - count;
+}
+
+static void alarm_timeout(unsigned long data)
+{
+	struct task_struct * p = (struct task_struct *) data;
+
+	p->alarm = 0;
+	p->signal |= (1<<(SIGALRM-1));
+	if (p->state == TASK_INTERRUPTIBLE)
+		wake_up_process(p);
+}
+
+/* SIGALRM to current at jiffies 'expires', or never if it's 0 */
+void set_alarm(long expires)
+{
+	struct timer_list * t = &current->alarm_timer;
+
+	del_timer(t);
+	if (current->alarm = expires) {
+		t->data = (unsigned long) current;
+		t->fn = alarm_timeout;
+		mod_timer(t,expires);
+	}
 }
 
 int sys_alarm(long seconds)
 {
-	current->alarm = (seconds>0)?(jiffies+HZ*seconds):0;
+	set_alarm((seconds>0)?(jiffies+HZ*seconds):0);
 	return seconds;
 }
 
@@ -211,6 +521,53 @@ int sys_nice(long increment)
 	return 0;
 }
 
+/*
+ * sched_setscheduler(pid,policy,prio) makes task 'pid' (0 = us) a
+ * SCHED_FIFO or SCHED_RR task with real-time priority prio (1-31, higher
+ * goes first), or a normal SCHED_OTHER one again (prio 0). Only root
+ * gets real-time priorities.
+ */
+int sys_sched_setscheduler(long pid, long policy, long prio)
+{
+	struct task_struct * p = NULL;
+	unsigned long flags;
+	int i;
+
+	if (policy == SCHED_OTHER) {
+		if (prio)
+			return -EINVAL;
+	} else if (policy == SCHED_FIFO || policy == SCHED_RR) {
+		if (prio < 1 || prio >= NR_RUNQ)
+			return -EINVAL;
+		if (current->euid)
+			return -EPERM;
+	} else
+		return -EINVAL;
+	if (!pid)
+		p = current;
+	else
+		for (i=1 ; i<NR_TASKS ; i++)
+			if (task[i] && task[i]->pid == pid) {
+				p = task[i];
+				break;
+			}
+	if (!p || p == task[0])
+		return -ESRCH;
+	if (current->euid && current->euid != p->uid && current->uid != p->uid)
+		return -EPERM;
+	save_flags(flags);
+	cli();
+	if (p->next_run)
+		del_from_runqueue(p);
+	p->policy = policy;
+	p->rt_priority = prio;
+	if (p->state == TASK_RUNNING)
+		add_to_runqueue(p);
+	need_resched = 1;
+	restore_flags(flags);
+	return 0;
+}
+
 int sys_signal(long signal,long addr,long restorer)
 {
 	long i;
@@ -245,9 +602,8 @@ void sched_init(void)
 	}
 	ltr(0);
 	lldt(0);
-	outb_p(0x36,0x43);		/* binary, mode 3, LSB/MSB, ch 0 */
-	outb_p(LATCH & 0xff , 0x40);	/* LSB */
-	outb(LATCH >> 8 , 0x40);	/* MSB */
+	timer_init();
+	set_pit(0x34,LATCH);		/* mode 2, so the count can be read */
 	set_intr_gate(0x20,&timer_interrupt);
 	outb(inb_p(0x21)&~0x01,0x21);
 	set_system_gate(0x80,&system_call);
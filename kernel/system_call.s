@@ -45,9 +45,10 @@ signal	= 12
 restorer = 16		# address of info-restorer
 sig_fn	= 20		# table of 32 signal addresses
 
-nr_system_calls = 67
+nr_system_calls = 70
 
 .globl _system_call,_sys_fork,_timer_interrupt,_hd_interrupt,_sys_execve
+.globl _sys_spawn
 
 .align 2
 bad_sys_call:
@@ -79,6 +80,8 @@ _system_call:
 	jne reschedule
 	cmpl $0,counter(%eax)		# counter
 	je reschedule
+	cmpl $0,_need_resched		# a real-time task woke up?
+	jne reschedule
 ret_from_sys_call:
 	movl _current,%eax		# task[0] cannot have signals
 	cmpl _task,%eax
@@ -173,6 +176,20 @@ _sys_execve:
 	addl $4,%esp
 	ret
 
+/*
+ * spawn has four arguments, one more than _system_call passes on: the
+ * fd mask comes in %esi, which nothing has touched.
+ */
+.align 2
+_sys_spawn:
+	pushl %esi		# fdmask
+	pushl 16(%esp)		# envp
+	pushl 16(%esp)		# argv
+	pushl 16(%esp)		# filename
+	call _do_spawn
+	addl $16,%esp
+	ret
+
 .align 2
 _sys_fork:
 	call _find_empty_process
@@ -209,7 +226,12 @@ _hd_interrupt:
 	jne 1f
 	movl $_unexpected_hd_interrupt,%eax
 1:	call *%eax		# "interesting" way of handling intr.
-	pop %fs
+	cmpl $0,_need_resched	# preempt, if it woke a real-time task
+	je 1f			# and we came from user mode
+	testl $3,28(%esp)
+	je 1f
+	call _schedule
+1:	pop %fs
 	pop %es
 	pop %ds
 	popl %edx
@@ -0,0 +1,170 @@
+/*
+ * 'timer.c' keeps the kernel timers in a timer wheel, so that adding,
+ * deleting and running them doesn't depend on how many there are.
+ *
+ * tv1 has a list for each of the next 256 ticks. Timers further away go
+ * to one of four coarser wheels of 64 lists each, covering 2^14, 2^20,
+ * 2^26 and 2^32 ticks. Every time tv1 wraps around, the next list of
+ * the wheel above is emptied into the finer ones ("cascading"), so a
+ * timer is moved at most four times before it runs.
+ */
+#include <linux/sched.h>
+#include <linux/timer.h>
+#include <asm/system.h>
+
+#define TVN_BITS 6
+#define TVR_BITS 8
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVR_MASK (TVR_SIZE - 1)
+
+/* list heads: circular, an empty one points to itself */
+static struct timer_list tv1[TVR_SIZE];
+static struct timer_list tvn[4][TVN_SIZE];
+
+/* the tick the wheel has been run up to */
+static unsigned long timer_jiffies = 0;
+
+#define INDEX(n) ((timer_jiffies >> (TVR_BITS + (n) * TVN_BITS)) & TVN_MASK)
+
+static void internal_add_timer(struct timer_list * timer)
+{
+	unsigned long expires = timer->expires;
+	unsigned long idx = expires - timer_jiffies;
+	struct timer_list * head;
+
+	if ((long) idx < 0)		/* already due: run it next tick */
+		head = tv1 + (timer_jiffies & TVR_MASK);
+	else if (idx < TVR_SIZE)
+		head = tv1 + (expires & TVR_MASK);
+	else if (idx < 1 << (TVR_BITS + TVN_BITS))
+		head = tvn[0] + ((expires >> TVR_BITS) & TVN_MASK);
+	else if (idx < 1 << (TVR_BITS + 2*TVN_BITS))
+		head = tvn[1] + ((expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK);
+	else if (idx < 1 << (TVR_BITS + 3*TVN_BITS))
+		head = tvn[2] + ((expires >> (TVR_BITS + 2*TVN_BITS)) & TVN_MASK);
+	else
+		head = tvn[3] + ((expires >> (TVR_BITS + 3*TVN_BITS)) & TVN_MASK);
+	timer->next = head;
+	timer->prev = head->prev;
+	head->prev->next = timer;
+	head->prev = timer;
+}
+
+static void detach_timer(struct timer_list * timer)
+{
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+	timer->next = timer->prev = NULL;
+}
+
+void add_timer(struct timer_list * timer)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (timer->next)
+		panic("add_timer: timer already added");
+	internal_add_timer(timer);
+	restore_flags(flags);
+}
+
+/* returns 1 if the timer was pending, 0 if it had run or wasn't added */
+int del_timer(struct timer_list * timer)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	save_flags(flags);
+	cli();
+	if (timer->next) {
+		detach_timer(timer);
+		ret = 1;
+	}
+	restore_flags(flags);
+	return ret;
+}
+
+void mod_timer(struct timer_list * timer, long expires)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (timer->next)
+		detach_timer(timer);
+	timer->expires = expires;
+	internal_add_timer(timer);
+	restore_flags(flags);
+}
+
+/* move list 'index' of wheel n down to the finer wheels, return index */
+static int cascade(int n, int index)
+{
+	struct timer_list * head = tvn[n] + index;
+	struct timer_list * timer;
+
+	while ((timer = head->next) != head) {
+		detach_timer(timer);
+		internal_add_timer(timer);
+	}
+	return index;
+}
+
+/*
+ * run_timers() is called from do_timer() every tick, with interrupts
+ * off. It catches up with jiffies one tick at a time, so a late call
+ * doesn't lose any timers.
+ */
+void run_timers(void)
+{
+	struct timer_list * head, * timer;
+	int index;
+
+	while ((long) (jiffies - timer_jiffies) >= 0) {
+		index = timer_jiffies & TVR_MASK;
+		if (!index &&
+		    !cascade(0,INDEX(0)) &&
+		    !cascade(1,INDEX(1)) &&
+		    !cascade(2,INDEX(2)))
+			cascade(3,INDEX(3));
+		timer_jiffies++;
+		head = tv1 + index;
+		while ((timer = head->next) != head) {
+			detach_timer(timer);
+			timer->fn(timer->data);
+		}
+	}
+}
+
+/*
+ * How many ticks from now (at most 'max') the timer interrupt can be left
+ * out for: up to the first tick that has timers to run, or that might
+ * get some by cascading.
+ */
+int timer_idle_ticks(int max)
+{
+	unsigned long j;
+	int i;
+
+	for (i=0 ; i<max ; i++) {
+		j = timer_jiffies + i;
+		if (!(j & TVR_MASK) || tv1[j & TVR_MASK].next != tv1 + (j & TVR_MASK))
+			return i+1;
+	}
+	return max;
+}
+
+void timer_init(void)
+{
+	int i,n;
+
+	for (i=0 ; i<TVR_SIZE ; i++)
+		tv1[i].next = tv1[i].prev = tv1+i;
+	for (n=0 ; n<4 ; n++)
+		for (i=0 ; i<TVN_SIZE ; i++)
+			tvn[n][i].next = tvn[n][i].prev = tvn[n]+i;
+	timer_jiffies = jiffies;
+}
@@ -7,7 +7,6 @@
 #include <errno.h>
 #include <signal.h>
 
-#define ALRMMASK (1<<(SIGALRM-1))
 
 #include <linux/sched.h>
 #include <linux/tty.h>
@@ -104,18 +103,28 @@ void tty_intr(struct tty_struct * tty, int signal)
 	if (tty->pgrp <= 0)
 		return;
 	for (i=0;i<NR_TASKS;i++)
-		if (task[i] && task[i]->pgrp==tty->pgrp)
+		if (task[i] && task[i]->pgrp==tty->pgrp) {
 			task[i]->signal |= 1<<(signal-1);
+			if (task[i]->state == TASK_INTERRUPTIBLE)
+				wake_up_process(task[i]);
+		}
 }
 
-static void sleep_if_empty(struct tty_queue * queue)
+/* sleep until there's something in the queue, or the timer has run */
+static void sleep_if_empty(struct tty_queue * queue, struct timer_list * timer)
 {
 	cli();
-	while (!current->signal && EMPTY(*queue))
+	while (!current->signal && EMPTY(*queue) &&
+	    !(timer->expires && !timer_pending(timer)))
 		interruptible_sleep_on(&queue->proc_list);
 	sti();
 }
 
+static void tty_timeout(unsigned long data)
+{
+	wake_up_process((struct task_struct *) data);
+}
+
 static void sleep_if_full(struct tty_queue * queue)
 {
 	if (!FULL(*queue))
@@ -196,57 +205,55 @@ int tty_read(unsigned channel, char * buf, int nr)
 {
 	struct tty_struct * tty;
 	char c, * b=buf;
-	int minimum,time,flag=0;
-	long oldalarm;
+	int minimum,time;
+	struct timer_list * timer = &current->timeout;
 
 	if (channel>2 || nr<0) return -1;
 	tty = &tty_table[channel];
-	oldalarm = current->alarm;
 	time = (unsigned) 10*tty->termios.c_cc[VTIME];
 	minimum = (unsigned) tty->termios.c_cc[VMIN];
+	init_timer(timer);
+	timer->expires = 0;
+	timer->data = (unsigned long) current;
+	timer->fn = tty_timeout;
 	if (time && !minimum) {
 		minimum=1;
-		if (flag=(!oldalarm || time+jiffies<oldalarm))
-			current->alarm = time+jiffies;
+		mod_timer(timer,jiffies+time);
 	}
 	if (minimum>nr)
 		minimum=nr;
 	while (nr>0) {
-		if (flag && (current->signal & ALRMMASK)) {
-			current->signal &= ~ALRMMASK;
+		if (timer->expires && !timer_pending(timer))
 			break;
-		}
 		if (current->signal)
 			break;
 		if (EMPTY(tty->secondary) || (L_CANON(tty) &&
 		!tty->secondary.data && LEFT(tty->secondary)>20)) {
-			sleep_if_empty(&tty->secondary);
+			sleep_if_empty(&tty->secondary,timer);
 			continue;
 		}
 		do {
 			GETCH(tty->secondary,c);
 			if (c==EOF_CHAR(tty) || c==10)
 				tty->secondary.data--;
-			if (c==EOF_CHAR(tty) && L_CANON(tty))
+			if (c==EOF_CHAR(tty) && L_CANON(tty)) {
+				del_timer(timer);
 				return (b-buf);
-			else {
+			} else {
 				put_fs_byte(c,b++);
 				if (!--nr)
 					break;
 			}
 		} while (nr>0 && !EMPTY(tty->secondary));
 		if (time && !L_CANON(tty))
-			if (flag=(!oldalarm || time+jiffies<oldalarm))
-				current->alarm = time+jiffies;
-			else
-				current->alarm = oldalarm;
+			mod_timer(timer,jiffies+time);
 		if (L_CANON(tty)) {
 			if (b-buf)
 				break;
 		} else if (b-buf >= minimum)
 			break;
 	}
-	current->alarm = oldalarm;
+	del_timer(timer);
 	if (current->signal && !(b-buf))
 		return -EINTR;
 	return (b-buf);
@@ -0,0 +1,4 @@
+#define __LIBRARY__
+#include <unistd.h>
+
+_syscall3(int,sched_setscheduler,pid_t,pid,int,policy,int,prio)
@@ -0,0 +1,4 @@
+#define __LIBRARY__
+#include <unistd.h>
+
+_syscall4(int,spawn,const char *,file,char **,argv,char **,envp,long,fdmask)
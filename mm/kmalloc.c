@@ -0,0 +1,145 @@
+/*
+ * kmalloc.c implements a simple allocator for small kernel objects.
+ *
+ * Memory comes from get_free_page() a page at a time, and every page
+ * holds objects of one size only: a power of two from 16 bytes (a 486
+ * cache line) up to 1kB. The page starts with a header, and the objects
+ * follow it aligned to their size, so no object straddles more cache
+ * lines than it has to. A page that becomes completely free is given
+ * back. Anything bigger than 1kB just gets a page of its own: such
+ * objects are recognized in kfree() by being page-aligned.
+ *
+ * NOTE! Not to be used from interrupts: nothing here is protected
+ * against them.
+ */
+#include <linux/kernel.h>
+#include <linux/mm.h>
+
+#ifndef NULL
+#define NULL ((void *) 0)
+#endif
+
+#define MAX_OBJECT 1024
+
+struct page_header {
+	struct page_header * next;	/* next page with free objects */
+	void * freelist;
+	unsigned short size;
+	unsigned short nr_free;
+};
+
+static struct size_class {
+	unsigned int size;
+	struct page_header * pages;	/* pages with free objects */
+	int nr_pages;
+	int in_use;
+	int allocs;
+} classes[] = {
+	{16}, {32}, {64}, {128}, {256}, {512}, {1024}, {0}
+};
+
+static int large_allocs = 0, large_in_use = 0;
+
+#define first_object(size) \
+	(((sizeof (struct page_header)+(size)-1)/(size))*(size))
+#define objects_per_page(size) ((PAGE_SIZE-first_object(size))/(size))
+
+static struct size_class * find_class(unsigned int size)
+{
+	struct size_class * c;
+
+	for (c = classes ; c->size ; c++)
+		if (c->size >= size)
+			return c;
+	return NULL;
+}
+
+void * kmalloc(unsigned int size)
+{
+	struct size_class * c;
+	struct page_header * page;
+	unsigned long obj;
+
+	if (!size || size > PAGE_SIZE)
+		return NULL;
+	if (size > MAX_OBJECT) {
+		if (obj = get_free_page()) {
+			large_allocs++;
+			large_in_use++;
+		}
+		return (void *) obj;
+	}
+	c = find_class(size);
+	if (!c->pages) {
+		if (!(page = (struct page_header *) get_uncleared_page()))
+			return NULL;
+		page->size = c->size;
+		page->nr_free = 0;
+		page->freelist = NULL;
+		obj = PAGE_SIZE + (unsigned long) page;
+		while ((obj -= c->size) >= first_object(c->size) +
+		    (unsigned long) page) {
+			*(void **) obj = page->freelist;
+			page->freelist = (void *) obj;
+			page->nr_free++;
+		}
+/* get_uncleared_page() may have freed objects of this size meanwhile */
+		page->next = c->pages;
+		c->pages = page;
+		c->nr_pages++;
+	}
+	page = c->pages;
+	obj = (unsigned long) page->freelist;
+	page->freelist = *(void **) obj;
+	if (!--page->nr_free)
+		c->pages = page->next;		/* full: off the list */
+	c->in_use++;
+	c->allocs++;
+	return (void *) obj;
+}
+
+void kfree(void * obj)
+{
+	struct size_class * c;
+	struct page_header * page, ** p;
+
+	if (!obj)
+		return;
+	if (!((unsigned long) obj & 0xfff)) {
+		large_in_use--;
+		free_page((unsigned long) obj);
+		return;
+	}
+	page = (struct page_header *) (0xfffff000 & (unsigned long) obj);
+	if (!(c = find_class(page->size)) || c->size != page->size)
+		panic("kfree: bad object");
+	*(void **) obj = page->freelist;
+	page->freelist = obj;
+	c->in_use--;
+	if (!page->nr_free++) {			/* was full: back on the list */
+		page->next = c->pages;
+		c->pages = page;
+	}
+	if (page->nr_free < objects_per_page(c->size))
+		return;
+	for (p = &c->pages ; *p ; p = &(*p)->next)
+		if (*p == page) {
+			*p = page->next;
+			c->nr_pages--;
+			free_page((unsigned long) page);
+			return;
+		}
+	panic("kfree: free page not on list");
+}
+
+void kmalloc_stats(void)
+{
+	struct size_class * c;
+
+	for (c = classes ; c->size ; c++)
+		if (c->nr_pages || c->allocs)
+			printk("kmalloc %4d: %d in use, %d pages, %d allocs\n\r",
+				c->size,c->in_use,c->nr_pages,c->allocs);
+	printk("kmalloc page: %d in use, %d allocs\n\r",
+		large_in_use,large_allocs);
+}
@@ -3,57 +3,185 @@
 #include <linux/config.h>
 #include <linux/head.h>
 #include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
 #include <asm/system.h>
 
 int do_exit(long code);
 
 #define invalidate() \
-__asm__("movl %%eax,%%cr3"::"a" (0))
+__asm__("movl %%cr3,%%eax\n\tmovl %%eax,%%cr3":::"ax")
 
-#if (BUFFER_END < 0x100000)
-#define LOW_MEM 0x100000
-#else
-#define LOW_MEM BUFFER_END
-#endif
+/*
+ * Every task has its own page directory, and the task switch reloads
+ * cr3, which flushes the TLB. So the TLB only ever holds entries of the
+ * current task (and of the kernel mappings it shares with all others):
+ * changing another task's tables needs no flushing, and invalidate()
+ * only throws away what the current task would have to re-read anyway.
+ * When just one of its entries has changed, invalidate_page() does
+ * better with invlpg - on a 486, that is. mem_init() finds out which we
+ * have. Making an entry present, or more permissive, needs no flushing
+ * at all: the cpu doesn't cache not-present entries, and re-reads the
+ * tables on a protection fault.
+ */
+#define invlpg(addr) \
+__asm__(".byte 0x0f,0x01,0x38"::"a" (addr))	/* invlpg (%eax) */
+
+static int has_invlpg = 0;
+
+static void invalidate_page(unsigned long addr)
+{
+	if (has_invlpg)
+		invlpg(addr);
+	else
+		invalidate();
+}
 
-/* these are not to be changed - thay are calculated from the above */
-#define PAGING_MEMORY (HIGH_MEMORY - LOW_MEM)
-#define PAGING_PAGES (PAGING_MEMORY/4096)
+/*
+ * mem_map covers everything from 1Mb to the 16Mb that head.s maps. How
+ * much of it is really there is only known at run-time (see main()):
+ * pages below start_mem (buffer memory) or past HIGH_MEMORY are marked
+ * USED, and never freed.
+ */
+#define LOW_MEM 0x100000
+#define PAGING_MEMORY (15*1024*1024)
+#define PAGING_PAGES (PAGING_MEMORY>>12)
 #define MAP_NR(addr) (((addr)-LOW_MEM)>>12)
+#define USED 100
+
+static unsigned long HIGH_MEMORY = 0;
+static int paging_pages = 0;
 
-#if (PAGING_PAGES < 10)
-#error "Won't work"
-#endif
+/* below LOW_MEM, so mem_map doesn't count its (many) users */
+#define ZERO_PAGE ((unsigned long) empty_zero_page)
 
 #define copy_page(from,to) \
 __asm__("cld ; rep ; movsl"::"S" (from),"D" (to),"c" (1024):"cx","di","si")
 
+#define clear_page(addr) \
+__asm__("cld ; rep ; stosl"::"a" (0),"D" (addr),"c" (1024):"cx","di")
+
 static unsigned short mem_map [ PAGING_PAGES ] = {0,};
+int nr_free_pages = 0;
 
 /*
- * Get physical address of first (actually last :-) free page, and mark it
- * used. If no free pages left, return 0.
+ * Free pages are kept on a list, linked through their first word, so
+ * that getting one doesn't mean searching mem_map. A page is on one of
+ * the lists exactly when its mem_map count is 0. The idle task clears
+ * free pages and moves them to the zeroed list (up to ZERO_POOL of them),
+ * so get_free_page() doesn't usually have to clear anything.
  */
+static unsigned long free_page_list = 0;
+static unsigned long zeroed_page_list = 0;
+static int nr_zeroed_pages = 0;
+
+#define ZERO_POOL 64
+
+/*
+ * Successful get_free_page()s, and the time (in timer_ticks()) taken by
+ * one call in ALLOC_SAMPLE, for calc_mem(). Reading the 8253 is slow, so
+ * timing every call would cost more than the allocation.
+ */
+#define ALLOC_SAMPLE 64
+
+unsigned long nr_page_allocs = 0;
+static unsigned long nr_page_calls = 0, nr_timed_allocs = 0;
+static unsigned long page_alloc_time = 0;
+
+void mem_init(long start_mem, long end_mem)
+{
+	unsigned long addr;
+	int i;
+
+	HIGH_MEMORY = end_mem;
+/* the AC flag can only be changed on a 486, which also has invlpg */
+	__asm__("pushfl ; popl %%eax ; movl %%eax,%%ecx\n\t"
+		"xorl $0x40000,%%eax ; pushl %%eax ; popfl\n\t"
+		"pushfl ; popl %%eax ; pushl %%ecx ; popfl\n\t"
+		"xorl %%ecx,%%eax ; andl $0x40000,%%eax"
+		:"=a" (has_invlpg)::"cx");
+	for (i=0 ; i<PAGING_PAGES ; i++)
+		mem_map[i] = USED;
+	for (addr = start_mem ; addr < HIGH_MEMORY ; addr += 4096) {
+		mem_map[MAP_NR(addr)] = 0;
+		*(unsigned long *) addr = free_page_list;
+		free_page_list = addr;
+		nr_free_pages++;
+	}
+	paging_pages = nr_free_pages;
+}
+
+/*
+ * Get physical address of a free page, and mark it used. If no free
+ * pages left, return 0. We make the buffer cache give back pages when
+ * memory gets low, and once more if there's nothing free at all.
+ */
+static unsigned long get_page(int clear)
+{
+	unsigned long page, * list, start = 0;
+	int timed = !(++nr_page_calls % ALLOC_SAMPLE);
+
+	if (timed)
+		start = timer_ticks();
+
+	if (nr_free_pages < FREE_PAGES_LOW)
+		shrink_buffers(FREE_PAGES_LOW - nr_free_pages);
+	if (!free_page_list && !zeroed_page_list)
+		shrink_buffers(1);
+	list = clear ? &zeroed_page_list : &free_page_list;
+	if (!*list)
+		list = clear ? &free_page_list : &zeroed_page_list;
+	if (page = *list) {
+		if (mem_map[MAP_NR(page)])
+			panic("get_free_page: free page in use");
+		*list = *(unsigned long *) page;
+		mem_map[MAP_NR(page)] = 1;
+		nr_free_pages--;
+		if (list == &zeroed_page_list) {
+			nr_zeroed_pages--;
+			*(unsigned long *) page = 0;
+		} else if (clear)
+			clear_page(page);
+		nr_page_allocs++;
+	}
+	if (timed) {
+		nr_timed_allocs++;
+		page_alloc_time += timer_ticks() - start;
+	}
+	return page;
+}
+
 unsigned long get_free_page(void)
 {
-register unsigned long __res asm("ax");
-
-__asm__("std ; repne ; scasw\n\t"
-	"jne 1f\n\t"
-	"movw $1,2(%%edi)\n\t"
-	"sall $12,%%ecx\n\t"
-	"movl %%ecx,%%edx\n\t"
-	"addl %2,%%edx\n\t"
-	"movl $1024,%%ecx\n\t"
-	"leal 4092(%%edx),%%edi\n\t"
-	"rep ; stosl\n\t"
-	"movl %%edx,%%eax\n"
-	"1:"
-	:"=a" (__res)
-	:"0" (0),"i" (LOW_MEM),"c" (PAGING_PAGES),
-	"D" (mem_map+PAGING_PAGES-1)
-	:"di","cx","dx");
-return __res;
+	return get_page(1);
+}
+
+/*
+ * get_uncleared_page() is for callers that fill the whole page at once
+ * anyway (copy_page() etc): the contents are random.
+ */
+unsigned long get_uncleared_page(void)
+{
+	return get_page(0);
+}
+
+/*
+ * zero_free_page() is called by the idle task. It only clears one page
+ * at a time, as nothing else gets to run until it returns, and returns
+ * 0 when there was nothing to do.
+ */
+int zero_free_page(void)
+{
+	unsigned long page;
+
+	if (nr_zeroed_pages >= ZERO_POOL || !(page = free_page_list))
+		return 0;
+	free_page_list = *(unsigned long *) page;
+	clear_page(page);
+	*(unsigned long *) page = zeroed_page_list;
+	zeroed_page_list = page;
+	nr_zeroed_pages++;
+	return 1;
 }
 
 /*
@@ -67,37 +195,58 @@ void free_page(unsigned long addr)
 		panic("trying to free nonexistent page");
 	addr -= LOW_MEM;
 	addr >>= 12;
-	if (mem_map[addr]--) return;
-	mem_map[addr]=0;
-	panic("trying to free free page");
+	if (!mem_map[addr])
+		panic("trying to free free page");
+	if (--mem_map[addr])
+		return;
+	addr = (addr<<12) + LOW_MEM;
+	*(unsigned long *) addr = free_page_list;
+	free_page_list = addr;
+	nr_free_pages++;
 }
 
 /*
- * This function frees a continuos block of page tables, as needed
- * by 'exit()'. As does copy_page_tables(), this handles only 4Mb blocks.
+ * put_table() drops one user of a page table. The last user frees the
+ * pages (and swap pages) in it as well.
  */
-int free_page_tables(unsigned long from,unsigned long size)
+static void put_table(unsigned long * table)
 {
-	unsigned long *pg_table;
-	unsigned long * dir, nr;
+	unsigned long page;
+	int nr;
+
+	if (mem_map[MAP_NR((unsigned long) table)] == 1)
+		for (nr=0 ; nr<1024 ; nr++) {
+			if (1 & (page = table[nr]))
+				free_page(0xfffff000 & page);
+			else if (page)
+				swap_free(page>>1);
+			table[nr] = 0;
+		}
+	free_page((unsigned long) table);
+}
+
+/*
+ * This function frees a continuos block of page tables of task p, as
+ * needed by 'exit()'. As does copy_page_tables(), this handles only 4Mb
+ * blocks. A page table that is still shared with another process (see
+ * copy_page_tables()) just loses a user: the pages in it stay. The page
+ * directory itself is freed by release().
+ */
+int free_page_tables(struct task_struct * p,
+	unsigned long from,unsigned long size)
+{
+	unsigned long * dir;
 
 	if (from & 0x3fffff)
 		panic("free_page_tables called with wrong alignment");
 	if (!from)
 		panic("Trying to free up swapper memory space");
 	size = (size + 0x3fffff) >> 22;
-	dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
+	dir = dir_entry(p,from);
 	for ( ; size-->0 ; dir++) {
 		if (!(1 & *dir))
 			continue;
-		pg_table = (unsigned long *) (0xfffff000 & *dir);
-		for (nr=0 ; nr<1024 ; nr++) {
-			if (1 & *pg_table)
-				free_page(0xfffff000 & *pg_table);
-			*pg_table = 0;
-			pg_table++;
-		}
-		free_page(0xfffff000 & *dir);
+		put_table((unsigned long *) (0xfffff000 & *dir));
 		*dir = 0;
 	}
 	invalidate();
@@ -106,12 +255,21 @@ int free_page_tables(unsigned long from,unsigned long size)
 
 /*
  *  Well, here is one of the most complicated functions in mm. It
- * copies a range of linerar addresses by copying only the pages.
+ * copies a range of linerar addresses by copying only the page tables.
  * Let's hope this is bug-free, 'cause this one I don't want to debug :-)
  *
  * Note! We don't copy just any chunks of memory - addresses have to
  * be divisible by 4Mb (one page-directory entry), as this makes the
- * function easier. It's used only by fork anyway.
+ * function easier. It's used only by fork anyway, to copy from the
+ * current task to the new one, p.
+ *
+ * We don't even copy the page tables: both processes get the same ones,
+ * with the directory entries write-protected, and mem_map counting the
+ * users of each table. The first write fault in the 4Mb then gives the
+ * writer a copy of its own (see unshare_table()), and only then do the
+ * pages themselves become copy-on-write. A child that just does an exec
+ * never needs any of that, and fork takes the same time whatever the
+ * size of the parent.
  *
  * NOTE 2!! When from==0 we are copying kernel space for the first
  * fork(). Then we DONT want to copy a full page-directory entry, as
@@ -121,7 +279,8 @@ int free_page_tables(unsigned long from,unsigned long size)
  * 1 Mb-range, so the pages can be shared with the kernel. Thus the
  * special case for nr=xxxx.
  */
-int copy_page_tables(unsigned long from,unsigned long to,long size)
+int copy_page_tables(struct task_struct * p,
+	unsigned long from,unsigned long to,long size)
 {
 	unsigned long * from_page_table;
 	unsigned long * to_page_table;
@@ -131,14 +290,20 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 
 	if ((from&0x3fffff) || (to&0x3fffff))
 		panic("copy_page_tables called with wrong alignment");
-	from_dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
-	to_dir = (unsigned long *) ((to>>20) & 0xffc);
+	from_dir = dir_entry(current,from);
+	to_dir = dir_entry(p,to);
 	size = ((unsigned) (size+0x3fffff)) >> 22;
 	for( ; size-->0 ; from_dir++,to_dir++) {
 		if (1 & *to_dir)
 			panic("copy_page_tables: already exist");
 		if (!(1 & *from_dir))
 			continue;
+		if (from) {
+			*from_dir &= ~2;
+			*to_dir = *from_dir;
+			mem_map[MAP_NR(0xfffff000 & *from_dir)]++;
+			continue;
+		}
 		from_page_table = (unsigned long *) (0xfffff000 & *from_dir);
 		if (!(to_page_table = (unsigned long *) get_free_page()))
 			return -1;	/* Out of memory, see freeing */
@@ -163,24 +328,66 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 }
 
 /*
- * This function puts a page in memory at the wanted address.
+ * unshare_table() is called with a write-protected directory entry, and
+ * makes the page table it points to private to the current process. If
+ * nobody else uses the table any more, that's just a matter of making
+ * the entry writable. Otherwise the table is copied, and every page in
+ * it becomes copy-on-write, as they are now in two tables. Swapped-out
+ * pages are copied too, and get one more user in swap_map.
+ */
+static void unshare_table(unsigned long * dir)
+{
+	unsigned long * old_table, * new_table;
+	unsigned long page;
+	int nr;
+
+	old_table = (unsigned long *) (0xfffff000 & *dir);
+	if (mem_map[MAP_NR((unsigned long) old_table)] == 1) {
+		*dir |= 2;
+		return;
+	}
+	if (!(new_table = (unsigned long *) get_free_page()))
+		do_exit(SIGSEGV);
+	for (nr=0 ; nr<1024 ; nr++) {
+		if (!(1 & (page = old_table[nr]))) {
+			if (page) {
+				swap_duplicate(page>>1);
+				new_table[nr] = page;
+			}
+			continue;
+		}
+		page &= ~2;
+		old_table[nr] = new_table[nr] = page;
+		if (page >= LOW_MEM)
+			mem_map[MAP_NR(page)]++;
+	}
+	mem_map[MAP_NR((unsigned long) old_table)]--;
+	*dir = ((unsigned long) new_table) | 7;
+	invalidate();
+}
+
+/*
+ * This function puts a page in memory at the wanted address of
+ * task p (spawn sets up a task that isn't running yet).
  * It returns the physical address of the page gotten, 0 if
  * out of memory (either when trying to access page-table or
  * page.)
  */
-unsigned long put_page(unsigned long page,unsigned long address)
+unsigned long put_task_page(struct task_struct * p,
+	unsigned long page,unsigned long address)
 {
 	unsigned long tmp, *page_table;
 
-/* NOTE !!! This uses the fact that _pg_dir=0 */
-
 	if (page < LOW_MEM || page > HIGH_MEMORY)
 		printk("Trying to put page %p at %p\n",page,address);
 	if (mem_map[(page-LOW_MEM)>>12] != 1)
 		printk("mem_map disagrees with %p at %p\n",page,address);
-	page_table = (unsigned long *) ((address>>20) & 0xffc);
-	if ((*page_table)&1)
+	page_table = dir_entry(p,address);
+	if ((*page_table)&1) {
+		if (!(*page_table & 2))
+			unshare_table(page_table);
 		page_table = (unsigned long *) (0xfffff000 & *page_table);
+	}
 	else {
 		if (!(tmp=get_free_page()))
 			return 0;
@@ -191,7 +398,149 @@ unsigned long put_page(unsigned long page,unsigned long address)
 	return page;
 }
 
-void un_wp_page(unsigned long * table_entry)
+unsigned long put_page(unsigned long page,unsigned long address)
+{
+	return put_task_page(current,page,address);
+}
+
+/*
+ * try_to_swap_out() looks at one page table entry for swap_out(). Pages
+ * that have been used since the last look just lose their accessed bit.
+ * A clean page of a program's text or data (clean_ok: it's below
+ * end_data) can simply be dropped, as do_no_page() will read it in
+ * again from the executable. Anything else is written to the swap device
+ * first: above end_data do_no_page() would only give back zeroes, and a
+ * page filled in by the kernel (exec's arguments) never looks dirty.
+ *
+ * The write sleeps, so the page is write-protected and the table gets an
+ * extra user for the duration: if the page has been written to, shared or
+ * freed by the time the write is done, or the write failed, we just
+ * forget about the swap page and keep the page. Only RW is cleared, and
+ * a page we keep is marked dirty: otherwise it might later be dropped or
+ * shared as if it still matched the executable.
+ */
+static inline void keep_page(unsigned long * table, int nr,
+	unsigned long phys)
+{
+	if ((table[nr] & 0xfffff001) == (phys | 1))
+		table[nr] |= 0x40;
+}
+
+static int try_to_swap_out(unsigned long * table, int nr,
+	unsigned long address, int clean_ok)
+{
+	unsigned long page, phys;
+	int swap_nr;
+
+	page = table[nr];
+	if (!(1 & page))
+		return 0;
+	phys = 0xfffff000 & page;
+	if (phys < LOW_MEM || phys >= HIGH_MEMORY || mem_map[MAP_NR(phys)] != 1)
+		return 0;
+	if (page & 0x20) {
+		table[nr] = page & ~0x20;
+		if (has_invlpg)
+			invlpg(address);
+		return 0;
+	}
+	if (clean_ok && !(page & 0x40)) {
+		table[nr] = 0;
+		invalidate_page(address);
+		free_page(phys);
+		return 1;
+	}
+	if (!(swap_nr = get_swap_page()))
+		return 0;
+	table[nr] = page &= ~2;
+	invalidate_page(address);
+	mem_map[MAP_NR((unsigned long) table)]++;
+	if (write_swap_page(swap_nr,phys)) {
+		keep_page(table,nr,phys);
+		swap_free(swap_nr);
+		put_table(table);
+		return 0;
+	}
+	if (table[nr] != page || mem_map[MAP_NR(phys)] != 1 ||
+	    mem_map[MAP_NR((unsigned long) table)] == 1) {
+		keep_page(table,nr,phys);
+		swap_free(swap_nr);
+		put_table(table);
+		return 1;
+	}
+	table[nr] = swap_nr << 1;
+	invalidate_page(address);
+	free_page(phys);
+	put_table(table);
+	return 1;
+}
+
+/*
+ * swap_out() is a clock over the address spaces of all tasks but task 0,
+ * remembering where it stopped. Going round twice means every page has
+ * had its accessed bit cleared, so if nothing turns up then, there is
+ * nothing to be had. Shared page tables are left alone: they'll get
+ * unshared soon enough. On a 386, the cleared accessed bits are made
+ * to count with a single invalidate() at the end.
+ */
+static int swap_out(void)
+{
+	static int task_nr = 1, page_nr = 0;
+	struct task_struct * p;
+	unsigned long * dir, base;
+	int loop;
+
+	for (loop=0 ; loop < 2*NR_TASKS ; loop++) {
+		if (p = task[task_nr]) {
+			base = get_base(p->ldt[1]);
+			dir = dir_entry(p,base);
+			for ( ; page_nr < (TASK_SIZE>>12) ; page_nr++) {
+				if ((3 & dir[page_nr>>10]) != 3) {
+					page_nr |= 1023;
+					continue;
+				}
+				if (try_to_swap_out((unsigned long *)
+				    (0xfffff000 & dir[page_nr>>10]),
+				    page_nr & 1023, base + (page_nr<<12),
+				    p->executable &&
+				    (page_nr<<12) < p->end_data)) {
+					page_nr++;
+					if (!has_invlpg)
+						invalidate();
+					return 1;
+				}
+			}
+		}
+		page_nr = 0;
+		if (++task_nr >= NR_TASKS)
+			task_nr = 1;
+	}
+	if (!has_invlpg)
+		invalidate();
+	return 0;
+}
+
+/*
+ * check_free_pages() is called at the start of the page fault handlers,
+ * where sleeping is ok, and makes sure there are FREE_PAGES_MIN pages
+ * free: first by shrinking the buffer cache, then by swapping. The
+ * callers must look at their page tables again afterwards.
+ */
+static void check_free_pages(void)
+{
+	int i;
+
+	for (i=0 ; i<16 && nr_free_pages < FREE_PAGES_MIN ; i++)
+		if (!shrink_buffers(FREE_PAGES_MIN-nr_free_pages) && !swap_out())
+			break;
+}
+
+/*
+ * un_wp_page() gives the page at 'address' a private writable copy. The
+ * old mapping may still be in the TLB when we get here from write_verify()
+ * rather than from a fault, so a new page means flushing it.
+ */
+void un_wp_page(unsigned long * table_entry, unsigned long address)
 {
 	unsigned long old_page,new_page;
 
@@ -200,11 +549,19 @@ void un_wp_page(unsigned long * table_entry)
 		*table_entry |= 2;
 		return;
 	}
-	if (!(new_page=get_free_page()))
+	if (old_page == ZERO_PAGE) {
+		if (!(new_page=get_free_page()))
+			do_exit(SIGSEGV);
+		*table_entry = new_page | 7;
+		invalidate_page(address);
+		return;
+	}
+	if (!(new_page=get_uncleared_page()))
 		do_exit(SIGSEGV);
 	if (old_page >= LOW_MEM)
 		mem_map[MAP_NR(old_page)]--;
 	*table_entry = new_page | 7;
+	invalidate_page(address);
 	copy_page(old_page,new_page);
 }	
 
@@ -215,46 +572,265 @@ void un_wp_page(unsigned long * table_entry)
  */
 void do_wp_page(unsigned long error_code,unsigned long address)
 {
-	un_wp_page((unsigned long *)
-		(((address>>10) & 0xffc) + (0xfffff000 &
-		*((unsigned long *) ((address>>20) &0xffc)))));
+	unsigned long * dir = dir_entry(current,address);
+	unsigned long * entry;
 
+	check_free_pages();
+	if (!(*dir & 2))
+		unshare_table(dir);
+	entry = (unsigned long *)
+		(((address>>10) & 0xffc) + (0xfffff000 & *dir));
+	if (1 & *entry)		/* might have been swapped out meanwhile */
+		un_wp_page(entry,address);
 }
 
 void write_verify(unsigned long address)
 {
-	unsigned long page;
+	unsigned long page, * dir;
 
-	if (!( (page = *((unsigned long *) ((address>>20) & 0xffc)) )&1))
+	check_free_pages();
+	dir = dir_entry(current,address);
+	if (!((page = *dir) & 1))
 		return;
+	if (!(page & 2)) {
+		unshare_table(dir);
+		page = *dir;
+	}
 	page &= 0xfffff000;
 	page += ((address>>10) & 0xffc);
 	if ((3 & *(unsigned long *) page) == 1)  /* non-writeable, present */
-		un_wp_page((unsigned long *) page);
+		un_wp_page((unsigned long *) page,address);
 	return;
 }
 
+void get_empty_page(unsigned long address)
+{
+	unsigned long tmp;
+
+	if (!(tmp=get_free_page()) || !put_page(tmp,address)) {
+		free_page(tmp);		/* 0 is ok - ignored */
+		do_exit(SIGSEGV);
+	}
+}
+
+/*
+ * get_zero_page() maps the zero page read-only at 'address'. Reading
+ * untouched memory then costs nothing: the first write gets a private
+ * page through do_wp_page(), like any other copy-on-write page.
+ */
+static void get_zero_page(unsigned long address)
+{
+	unsigned long tmp, * dir;
+
+	dir = dir_entry(current,address);
+	if (1 & *dir) {
+		if (!(*dir & 2))
+			unshare_table(dir);
+	} else {
+		if (!(tmp=get_free_page()))
+			do_exit(SIGSEGV);
+		*dir = tmp | 7;
+	}
+	tmp = (0xfffff000 & *dir) + ((address>>10) & 0xffc);
+	*(unsigned long *) tmp = ZERO_PAGE | 5;
+}
+
+/*
+ * try_to_share() checks the page at 'address' in task p, and if it's
+ * present, clean (never written to) and write-protected already, maps
+ * it at the same address in the current process too. A write gets a
+ * private copy as usual. A page p can still write to is left alone: p
+ * may be in the middle of a system call that has done verify_area() on
+ * it, and the kernel ignores write-protection.
+ *
+ * NOTE! 'address' is relative to the start of the code segment.
+ */
+static int try_to_share(unsigned long address, struct task_struct * p)
+{
+	unsigned long from, to, phys_addr, tmp;
+	unsigned long * from_dir, * to_dir, * from_page, * to_page;
+
+	from = address + get_base(p->ldt[1]);
+	to = address + get_base(current->ldt[1]);
+	from_dir = dir_entry(p,from);
+	if (!(*from_dir & 1))
+		return 0;
+	from_page = (unsigned long *)
+		((0xfffff000 & *from_dir) + ((from>>10) & 0xffc));
+	phys_addr = *from_page;
+	if ((phys_addr & 0x43) != 0x01)		/* present, not dirty, r/o */
+		return 0;
+	phys_addr &= 0xfffff000;
+	if (phys_addr < LOW_MEM || phys_addr >= HIGH_MEMORY)
+		return 0;
+	to_dir = dir_entry(current,to);
+	if (!(*to_dir & 1)) {
+		if (!(tmp = get_free_page()))
+			do_exit(SIGSEGV);
+		*to_dir = tmp | 7;
+	} else if (!(*to_dir & 2))
+		unshare_table(to_dir);
+	to_page = (unsigned long *)
+		((0xfffff000 & *to_dir) + ((to>>10) & 0xffc));
+	if (1 & *to_page)
+		panic("try_to_share: to_page already exists");
+	*to_page = *from_page;
+	mem_map[MAP_NR(phys_addr)]++;
+	return 1;
+}
+
+/*
+ * share_page() looks for another process running the same executable
+ * that already has the page, so that many copies of a program share
+ * their text (and any data they haven't written yet).
+ */
+static int share_page(unsigned long address)
+{
+	struct task_struct ** p;
+
+	if (!current->executable || current->executable->i_count < 2)
+		return 0;
+	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
+		if (!*p || current == *p)
+			continue;
+		if ((*p)->executable != current->executable)
+			continue;
+		if (try_to_share(address,*p))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * read_around() starts reading the blocks of the next READ_AROUND pages
+ * after a demand-loaded one, so that they are in the buffer cache (or on
+ * their way there) by the time they are faulted in.
+ */
+#define READ_AROUND 4
+
+static void read_around(struct m_inode * inode,int block,int end)
+{
+	int i,nr;
+
+	if (end > block + READ_AROUND*4)
+		end = block + READ_AROUND*4;
+	for (i=block ; i<end ; i++)
+		if (nr = bmap(inode,i))
+			breada(inode->i_dev,nr);
+}
+
+/*
+ * swap_in() reads back a swapped-out page. It's dirty as far as we are
+ * concerned: it has to go to the swap device again if it's swapped out.
+ */
+static void swap_in(unsigned long * entry)
+{
+	unsigned long page;
+	int nr;
+
+	if (!(page = get_uncleared_page()))
+		do_exit(SIGSEGV);
+	nr = *entry >> 1;
+	if (read_swap_page(nr,page)) {
+		free_page(page);	/* the entry is freed when we exit */
+		do_exit(SIGSEGV);
+	}
+	if (*entry != (nr << 1)) {
+		free_page(page);
+		return;
+	}
+	swap_free(nr);
+	*entry = page | 0x47;
+}
+
+/*
+ * do_no_page() loads the text and data of executables on demand: exec
+ * only sets up current->executable, and the pages are read in from it as
+ * they are touched. Anything past end_data (bss, brk, stack) is a fresh
+ * zeroed page. The a.out header takes up block 0 of the file (ZMAGIC), so
+ * page n of the program starts at block 1+4*n. A non-zero entry that
+ * isn't present is a page on the swap device. Reads of memory that has
+ * never been written get the zero page.
+ */
 void do_no_page(unsigned long error_code,unsigned long address)
 {
+	int nr[4];
 	unsigned long tmp;
+	unsigned long page;
+	unsigned long * dir;
+	int block,i,text;
 
-	if (tmp=get_free_page())
-		if (put_page(tmp,address))
+	check_free_pages();
+	address &= 0xfffff000;
+	dir = dir_entry(current,address);
+	if (1 & *dir) {
+		page = (0xfffff000 & *dir) + ((address>>10) & 0xffc);
+		if (1 & *(unsigned long *) page)
 			return;
-	do_exit(SIGSEGV);
+		if (*(unsigned long *) page) {
+			if (!(*dir & 2)) {
+				unshare_table(dir);
+				page = (0xfffff000 & *dir) + ((address>>10) & 0xffc);
+			}
+			swap_in((unsigned long *) page);
+			return;
+		}
+	}
+	tmp = address - get_base(current->ldt[1]);
+	if (!current->executable || tmp >= current->end_data) {
+		if (error_code & 2)
+			get_empty_page(address);
+		else
+			get_zero_page(address);
+		return;
+	}
+	if (share_page(tmp))
+		return;
+	text = tmp + PAGE_SIZE <= current->end_code;
+	if (!(page = get_free_page()))
+		do_exit(SIGSEGV);
+	block = 1 + tmp/BLOCK_SIZE;
+	for (i=0 ; i<4 ; block++,i++)
+		nr[i] = bmap(current->executable,block);
+	if (bread_page(page,current->executable->i_dev,nr)) {
+		free_page(page);	/* don't run a page of zeroes */
+		do_exit(SIGSEGV);
+	}
+	i = tmp + 4096 - current->end_data;
+	tmp = page + 4096;
+	while (i-- > 0) {
+		tmp--;
+		*(char *)tmp = 0;
+	}
+	if (!put_page(page,address)) {
+		free_page(page);
+		do_exit(SIGSEGV);
+	}
+/* pure text is mapped read-only, so that try_to_share() can hand it out */
+	if (text) {
+		dir = dir_entry(current,address);
+		((unsigned long *) (0xfffff000 & *dir))[(address>>12) & 0x3ff] &= ~2;
+	}
+	read_around(current->executable,block,
+		1 + (current->end_data+BLOCK_SIZE-1)/BLOCK_SIZE);
 }
 
 void calc_mem(void)
 {
 	int i,j,k,free=0;
-	long * pg_tbl;
+	long * pg_tbl, * dir = (long *) current->tss.cr3;
 
 	for(i=0 ; i<PAGING_PAGES ; i++)
 		if (!mem_map[i]) free++;
-	printk("%d pages free (of %d)\n\r",free,PAGING_PAGES);
-	for(i=2 ; i<1024 ; i++) {
-		if (1&pg_dir[i]) {
-			pg_tbl=(long *) (0xfffff000 & pg_dir[i]);
+	printk("%d pages free (of %d)\n\r",free,paging_pages);
+	printk("%d page allocations\n\r",nr_page_allocs);
+	if (nr_timed_allocs)
+		printk("%d timer ticks each (1 in %d timed)\n\r",
+			page_alloc_time/nr_timed_allocs,ALLOC_SAMPLE);
+	printk("%d free pages cleared\n\r",nr_zeroed_pages);
+	for(i=TASK_BASE>>22 ; i<1024 ; i++) {
+		if (1&dir[i]) {
+			pg_tbl=(long *) (0xfffff000 & dir[i]);
 			for(j=k=0 ; j<1024 ; j++)
 				if (pg_tbl[j]&1)
 					k++;
@@ -0,0 +1,140 @@
+/*
+ * swap.c handles the swap device: which pages of it are in use, and
+ * reading and writing pages to it. Picking the pages to swap out is done
+ * in memory.c, as it needs mem_map.
+ *
+ * The swap device is a partition (SWAP_DEV in <linux/config.h>) whose
+ * first page holds a bitmap of the usable pages, with "SWAP-SPACE" in the
+ * last 10 bytes. A swapped-out page is a page table entry with the
+ * present bit clear, and the swap page number in the rest.
+ */
+#include <string.h>
+
+#include <linux/config.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+
+#define SWAP_PAGES 4096		/* 16Mb, and swap_map fits in a page */
+#define SWAP_UNUSED 255		/* swap_map value of pages we can't use */
+
+/* swap_map counts the page table entries referring to each swap page */
+static unsigned char * swap_map = NULL;
+static int nr_swap_pages = 0;
+
+#define bit(addr,nr) ({ \
+register int __res __asm__("ax"); \
+__asm__("bt %2,%3;setb %%al":"=a" (__res):"a" (0),"r" (nr),"m" (*(addr))); \
+__res; })
+
+/*
+ * The I/O goes through the block layer, but not through the cache: the
+ * buffer heads live on the stack, and point straight at the page.
+ * Returns -1 on an I/O error, 0 if all went well.
+ */
+static int rw_swap_page(int rw, int nr, unsigned long page)
+{
+	struct buffer_head bh[PAGE_SIZE/BLOCK_SIZE];
+	int i,error = 0;
+
+	for (i=0 ; i<PAGE_SIZE/BLOCK_SIZE ; i++) {
+		bh[i].b_data = (char *) (page + i*BLOCK_SIZE);
+		bh[i].b_dev = SWAP_DEV;
+		bh[i].b_blocknr = nr*(PAGE_SIZE/BLOCK_SIZE) + i;
+		bh[i].b_uptodate = (rw == WRITE);
+		bh[i].b_dirt = 0;
+		bh[i].b_count = 1;
+		bh[i].b_lock = 0;
+		bh[i].b_wait = NULL;
+		bh[i].b_reqnext = NULL;
+		bh[i].b_nocache = 1;
+		ll_rw_block(rw,bh+i);
+	}
+	for (i=0 ; i<PAGE_SIZE/BLOCK_SIZE ; i++) {
+		wait_on_buffer(bh+i);
+		if (!bh[i].b_uptodate)
+			error = -1;
+	}
+	if (error)
+		printk("swap: I/O error on page %d\n\r",nr);
+	return error;
+}
+
+int read_swap_page(int nr, unsigned long page)
+{
+	return rw_swap_page(READ,nr,page);
+}
+
+int write_swap_page(int nr, unsigned long page)
+{
+	return rw_swap_page(WRITE,nr,page);
+}
+
+/*
+ * Returns a free swap page with a count of 1, or 0 if there is none
+ * (page 0 is the bitmap, so it's never handed out).
+ */
+int get_swap_page(void)
+{
+	int nr;
+
+	if (!swap_map)
+		return 0;
+	for (nr=1 ; nr<SWAP_PAGES ; nr++)
+		if (!swap_map[nr]) {
+			swap_map[nr] = 1;
+			nr_swap_pages--;
+			return nr;
+		}
+	return 0;
+}
+
+void swap_duplicate(int nr)
+{
+	if (!swap_map || nr <= 0 || nr >= SWAP_PAGES ||
+	    !swap_map[nr] || swap_map[nr] >= SWAP_UNUSED-1)
+		panic("swap_duplicate: bad swap page");
+	swap_map[nr]++;
+}
+
+void swap_free(int nr)
+{
+	if (!swap_map || nr <= 0 || nr >= SWAP_PAGES ||
+	    !swap_map[nr] || swap_map[nr] == SWAP_UNUSED)
+		panic("swap_free: bad swap page");
+	if (!--swap_map[nr])
+		nr_swap_pages++;
+}
+
+/*
+ * swap_init() is called by sys_setup() once the partition tables are
+ * known. It reads the bitmap, and sets up swap_map from it.
+ */
+void swap_init(void)
+{
+	unsigned long page;
+	int i;
+
+	if (!SWAP_DEV)
+		return;
+	if (!(swap_map = (unsigned char *) get_free_page()) ||
+	    !(page = get_free_page()))
+		panic("Unable to get memory for swapping");
+	if (read_swap_page(0,page) ||
+	    strncmp("SWAP-SPACE",(char *) page+PAGE_SIZE-10,10)) {
+		printk("Unable to find swap-space signature\n\r");
+		free_page((unsigned long) swap_map);
+		free_page(page);
+		swap_map = NULL;
+		return;
+	}
+	for (i=0 ; i<SWAP_PAGES ; i++)
+		if (i && i < 8*(PAGE_SIZE-10) && bit((char *) page,i)) {
+			swap_map[i] = 0;
+			nr_swap_pages++;
+		} else
+			swap_map[i] = SWAP_UNUSED;
+	free_page(page);
+	printk("Swap device ok: %d pages (%dkB) of swap space\n\r",
+		nr_swap_pages,nr_swap_pages*(PAGE_SIZE/1024));
+}